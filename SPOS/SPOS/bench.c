@@ -0,0 +1,312 @@
+//-------------------------------------------------
+//          Benchmark: Kernel primitives
+//-------------------------------------------------
+
+#include <stdbool.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+#include "lcd.h"
+#include "util.h"
+#include "format.h"
+#include "os_core.h"
+#include "os_scheduler.h"
+#include "os_scheduling_strategies.h"
+
+#if OS_BENCHMARK
+
+#if OS_TRACE
+#error "The benchmark sends its results over USART0, which is used by OS_TRACE"
+#endif
+
+//---- Adjust here what to measure ----------------
+#define BENCH_SWITCH   1
+#define BENCH_CRITICAL 1
+#define BENCH_EXEC     1
+#define BENCH_CHECKSUM 1
+#define BENCH_LCD      1
+#define BENCH_TIME     1
+//-------------------------------------------------
+
+/*
+ * Every primitive is measured BENCH_RUNS times with timer 1 running at the
+ * CPU clock, so all results are in CPU cycles. The minimum, the average and
+ * the maximum are shown on the LCD and sent over USART0 as a line
+ *
+ *   BENCH <name> min=<cycles> avg=<cycles> max=<cycles> n=<runs>
+ *
+ * Interrupts stay enabled, so the maximum may include an ISR. When all
+ * results are sent, the CPU sleeps with interrupts disabled, which also
+ * ends a simulation in simavr (see make bench).
+ */
+
+//! Number of times each primitive is measured
+#define BENCH_RUNS 32
+
+//! Baud rate of the result lines
+#define BENCH_BAUD 250000ul
+
+//! USART0 baud rate register value for BENCH_BAUD
+#define BENCH_UBRR (F_CPU / 16 / BENCH_BAUD - 1)
+
+//! Minimum, maximum and sum of the measured cycles of a primitive
+typedef struct {
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+	uint16_t count;
+} BenchResult;
+
+//! An empty result
+#define BENCH_RESULT_INIT ((BenchResult){ .min = UINT16_MAX })
+
+//! Cycles it takes to read timer 1 twice, subtracted from every measurement
+static uint16_t benchOverhead = 0;
+
+//! Measures the cycles a statement takes
+#define BENCH_MEASURE(RESULT, STATEMENT) \
+do { \
+	uint16_t const start = TCNT1; \
+	STATEMENT; \
+	uint16_t const end = TCNT1; \
+	bench_add(RESULT, end - start - benchOverhead); \
+} while (0)
+
+//! Short names of the scheduling strategies
+static char const benchStrategyNames[OS_SS_COUNT][6] PROGMEM = {
+	[OS_SS_EVEN]              = "even",
+	[OS_SS_RANDOM]            = "rand",
+	[OS_SS_RUN_TO_COMPLETION] = "rtc",
+	[OS_SS_ROUND_ROBIN]       = "rr",
+	[OS_SS_INACTIVE_AGING]    = "aging",
+	[OS_SS_EDF]               = "edf",
+};
+
+static void bench_add(BenchResult* result, uint16_t cycles) {
+	if (cycles < result->min) {
+		result->min = cycles;
+	}
+	if (cycles > result->max) {
+		result->max = cycles;
+	}
+	result->sum += cycles;
+	result->count++;
+}
+
+static void bench_uartChar(char character) {
+	while (!(UCSR0A & (1 << UDRE0))) {
+	}
+	UDR0 = character;
+}
+
+/*
+ * Sends a result line over USART0 and shows the result on the LCD.
+ * Name and variant are strings in the program flash memory, the variant
+ * may be NULL.
+ */
+static void bench_report(char const* name, char const* variant, BenchResult const* result) {
+	uint16_t const avg = result->count ? result->sum / result->count : 0;
+	uint16_t const min = result->count ? result->min : 0;
+	fmt_printf_P(bench_uartChar, PSTR("BENCH %S%S%S min=%u avg=%u max=%u n=%u\r\n"), name,
+	             variant ? PSTR("_") : PSTR(""), variant ? variant : PSTR(""),
+	             min, avg, result->max, result->count);
+
+	lcd_clear();
+	lcd_writeProgString(name);
+	if (variant) {
+		lcd_writeChar(' ');
+		lcd_writeProgString(variant);
+	}
+	lcd_line2();
+	lcd_writeDec(min);
+	lcd_writeChar('/');
+	lcd_writeDec(avg);
+	lcd_writeChar('/');
+	lcd_writeDec(result->max);
+	delayMs(DEFAULT_OUTPUT_DELAY * 10);
+}
+
+#if BENCH_SWITCH
+
+//! Timer 1 when the worker that ran last was about to be switched out
+static volatile uint16_t switchStamp;
+
+//! The worker that ran last, INVALID_PROCESS to skip the next switch
+static volatile ProcessID switchOwner;
+
+//! The measured switches between the workers
+static BenchResult switchResult;
+
+/*
+ * Two of these run at the same time and take a timestamp with interrupts
+ * disabled over and over. The first timestamp after a switch minus the last
+ * one of the other worker is the time the scheduler ISR took, including the
+ * few cycles until interrupts are enabled again.
+ */
+static void bench_switchWorker(void) {
+	ProcessID const self = os_getCurrentProc();
+	for (;;) {
+		cli();
+		uint16_t const now = TCNT1;
+		if (switchOwner != self) {
+			if (switchOwner != INVALID_PROCESS && switchResult.count < BENCH_RUNS) {
+				bench_add(&switchResult, now - switchStamp);
+			}
+			switchOwner = self;
+		}
+		switchStamp = TCNT1;
+		sei();
+	}
+}
+
+/*
+ * Measures a process switch by the scheduler ISR for every strategy that
+ * switches between two ready processes of the same priority.
+ * Run-to-completion never does.
+ */
+static void bench_switch(void) {
+	SchedulingStrategy const previous = os_getSchedulingStrategy();
+	for (SchedulingStrategy strategy = 0; strategy < OS_SS_COUNT; strategy++) {
+#ifdef OS_FIXED_SCHEDULING_STRATEGY
+		if (strategy != OS_FIXED_SCHEDULING_STRATEGY) {
+			continue;
+		}
+#endif
+		if (strategy == OS_SS_RUN_TO_COMPLETION) {
+			continue;
+		}
+		os_setSchedulingStrategy(strategy);
+		switchResult = BENCH_RESULT_INIT;
+		switchOwner = INVALID_PROCESS;
+		ProcessID const a = os_exec(bench_switchWorker, DEFAULT_PRIORITY);
+		ProcessID const b = os_exec(bench_switchWorker, DEFAULT_PRIORITY);
+		os_setProcessQuantum(a, 1);
+		os_setProcessQuantum(b, 1);
+		while (switchResult.count < BENCH_RUNS) {
+			os_sleep(10);
+			// The switches to and from this process are not measured
+			cli();
+			switchOwner = INVALID_PROCESS;
+			sei();
+		}
+		os_kill(a);
+		os_kill(b);
+		bench_report(PSTR("switch"), benchStrategyNames[strategy], &switchResult);
+	}
+	os_setSchedulingStrategy(previous);
+}
+
+#endif
+
+#if BENCH_EXEC
+
+//! The program of the processes that are started and killed right away
+static void bench_nop(void) {
+}
+
+#endif
+
+REGISTER_AUTOSTART(bench_program)
+void bench_program(void) {
+	// Timer 1 counts CPU cycles
+	TCCR1A = 0;
+	TCCR1B = 1 << CS10;
+
+	UBRR0 = BENCH_UBRR;
+	UCSR0A = 0;
+	UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+	UCSR0B = 1 << TXEN0;
+
+	benchOverhead = UINT16_MAX;
+	for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+		uint16_t const start = TCNT1;
+		uint16_t const end = TCNT1;
+		if (end - start < benchOverhead) {
+			benchOverhead = end - start;
+		}
+	}
+
+	lcd_clear();
+	lcd_writeProgString(PSTR("Benchmark"));
+	lcd_line2();
+	lcd_writeProgString(PSTR("min/avg/max cyc"));
+	delayMs(DEFAULT_OUTPUT_DELAY * 10);
+
+	#if BENCH_SWITCH
+	bench_switch();
+	#endif
+
+	#if BENCH_CRITICAL
+	{
+		BenchResult result = BENCH_RESULT_INIT;
+		for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+			BENCH_MEASURE(&result, os_enterCriticalSection(); os_leaveCriticalSection());
+		}
+		bench_report(PSTR("critical"), NULL, &result);
+	}
+	#endif
+
+	#if BENCH_EXEC
+	{
+		BenchResult exec = BENCH_RESULT_INIT;
+		BenchResult kill = BENCH_RESULT_INIT;
+		for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+			// The new process must not run and end itself before it is killed
+			os_enterCriticalSection();
+			ProcessID pid;
+			BENCH_MEASURE(&exec, pid = os_exec(bench_nop, DEFAULT_PRIORITY));
+			BENCH_MEASURE(&kill, os_kill(pid));
+			os_leaveCriticalSection();
+		}
+		bench_report(PSTR("exec"), NULL, &exec);
+		bench_report(PSTR("kill"), NULL, &kill);
+	}
+	#endif
+
+	#if BENCH_CHECKSUM
+	{
+		BenchResult result = BENCH_RESULT_INIT;
+		ProcessID const self = os_getCurrentProc();
+		for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+			BENCH_MEASURE(&result, os_getStackChecksum(self));
+		}
+		bench_report(PSTR("checksum"), NULL, &result);
+	}
+	#endif
+
+	#if BENCH_LCD
+	{
+		BenchResult result = BENCH_RESULT_INIT;
+		lcd_clear();
+		for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+			BENCH_MEASURE(&result, lcd_writeChar('0' + i % 10));
+		}
+		bench_report(PSTR("lcd_char"), NULL, &result);
+	}
+	#endif
+
+	#if BENCH_TIME
+	{
+		BenchResult result = BENCH_RESULT_INIT;
+		for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+			BENCH_MEASURE(&result, os_systemTime_precise());
+		}
+		bench_report(PSTR("time_precise"), NULL, &result);
+	}
+	#endif
+
+	UCSR0A = 1 << TXC0; // Cleared by writing a one
+	fmt_printf_P(bench_uartChar, PSTR("BENCH done\r\n"));
+	while (!(UCSR0A & (1 << TXC0))) {
+	}
+	lcd_clear();
+	lcd_writeProgString(PSTR("Benchmark done"));
+	delayMs(DEFAULT_OUTPUT_DELAY * 10);
+	cli();
+	sleep_enable();
+	sleep_cpu();
+	HALT;
+}
+
+#endif
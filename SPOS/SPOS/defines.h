@@ -32,7 +32,15 @@
 //----------------------------------------------------------------------------
 
 //! The current id of the exercise (this must be changed every two weeks).
-#define VERSUCH 2
+#define VERSUCH 3
+
+/*!
+ *  If set to 1, the benchmark of the kernel primitives in bench.c is run
+ *  instead of the test in progs.c (see make bench).
+ */
+#ifndef OS_BENCHMARK
+#define OS_BENCHMARK                0
+#endif
 
 //----------------------------------------------------------------------------
 // System constants
@@ -40,11 +48,15 @@
 
 /*!
  *  Maximum number of processes that can be running at the same time
- *  (may be nothing > 8).
+ *  (may be nothing > 32).
  *  This number includes the idle proc, although it is considered a system proc.
  *  The idle proc. has always id 0. The highest ID is MAX_NUMBER_OF_PROCESSES-1.
+ *  Process sets grow to two bytes above 8 and to four bytes above 16
+ *  processes. Processes with an ID above 14 cannot own heap memory.
  */
+#ifndef MAX_NUMBER_OF_PROCESSES
 #define MAX_NUMBER_OF_PROCESSES     8
+#endif
 
 //! Standard priority for newly created processes
 #define DEFAULT_PRIORITY            2
@@ -61,6 +73,153 @@
 //! Number to specify an invalid process
 #define INVALID_PROCESS             255
 
+//! Compare value of timer 2 for one scheduler tick (prescaler 1024, ~3 ms)
+#define DEFAULT_TICK_PERIOD         60
+
+//! Shortest tick period accepted by os_setTickPeriod (about 0.4 ms)
+#define MIN_TICK_PERIOD             8
+
+/*!
+ *  If set to 1, the scheduler stretches its tick as far as timer 2 allows
+ *  while only the idle process is ready, and the idle process puts the MCU
+ *  to sleep instead of busy waiting.
+ */
+#ifndef OS_TICKLESS_IDLE
+#define OS_TICKLESS_IDLE            1
+#endif
+
+/*!
+ *  If defined (e.g. to OS_SS_ROUND_ROBIN), this strategy is the only one
+ *  the scheduler uses. It is called directly instead of through the
+ *  strategy table, and the other strategies are dropped by the linker.
+ *  Leave it undefined to switch strategies at runtime.
+ */
+// #define OS_FIXED_SCHEDULING_STRATEGY OS_SS_ROUND_ROBIN
+
+/*!
+ *  If set to 1, the scheduler times every process switch and accounts the
+ *  CPU time of each process. The results are shown by the task manager.
+ */
+#ifndef OS_SCHEDULER_STATS
+#define OS_SCHEDULER_STATS          0
+#endif
+
+/*!
+ *  Share of the CPU in percent that the admission control of OS_SS_EDF
+ *  hands out to periodic processes. The rest is left to the scheduler
+ *  itself and to the other processes.
+ */
+#define OS_EDF_UTILIZATION          90
+
+/*!
+ *  If set to 1, the task manager runs in a process of its own that the
+ *  scheduler wakes when the buttons are pressed, instead of inside the
+ *  scheduler ISR. The other processes keep running while it is open, so
+ *  the display is garbled by processes that write to the LCD meanwhile.
+ *  The scheduler stack then no longer has to hold the task manager.
+ */
+#ifndef OS_TASKMAN_PROCESS
+#define OS_TASKMAN_PROCESS          0
+#endif
+
+//! Priority of the task manager process
+#define OS_TASKMAN_PRIORITY         255
+
+//! Stack size of the task manager process (its pages and one nested ISR)
+#define OS_TASKMAN_STACK_SIZE       256
+
+//----------------------------------------------------------------------------
+// Input constants
+//----------------------------------------------------------------------------
+
+/*!
+ *  If set to 1, button changes are detected by the pin change interrupt of
+ *  PORTC, debounced and queued as events, and the scheduler no longer polls
+ *  the buttons. This takes over PCINT2_vect; programs that need to see pin
+ *  changes register a hook with os_setPinChangeHook instead. If set to 0,
+ *  the scheduler polls the buttons on every tick to detect the task manager
+ *  chord, and programs may install their own pin change ISR.
+ */
+#ifndef OS_INPUT_EVENTS
+#define OS_INPUT_EVENTS             1
+#endif
+
+//! Number of timer 0 overflows (~3.3 ms each) a button has to be stable
+#define INPUT_DEBOUNCE_TICKS        3
+
+//! Number of input events that can be queued
+#define INPUT_EVENT_QUEUE_SIZE      8
+
+//----------------------------------------------------------------------------
+// Memory constants
+//----------------------------------------------------------------------------
+
+/*!
+ *  If set to 1, a second heap is set up in the 23LC1024 SRAM on the SPI bus
+ *  (chip select PB4). Leave it 0 on boards without the chip.
+ */
+#ifndef OS_EXTERNAL_SRAM
+#define OS_EXTERNAL_SRAM            0
+#endif
+
+//! Number of block pools that can exist at the same time
+#define OS_POOL_COUNT               4
+
+//! Number of free runs every heap keeps in its index (at most 255)
+#ifndef OS_MEM_RUN_COUNT
+#define OS_MEM_RUN_COUNT            8
+#endif
+
+//----------------------------------------------------------------------------
+// Timer constants
+//----------------------------------------------------------------------------
+
+//! Number of software timers that can run at the same time (at most 8)
+#ifndef OS_TIMER_COUNT
+#define OS_TIMER_COUNT              8
+#endif
+
+//! Priority of the process that calls the timer callbacks
+#define OS_TIMER_PRIORITY           4
+
+//----------------------------------------------------------------------------
+// Task constants
+//----------------------------------------------------------------------------
+
+//! Number of levels of run-to-completion tasks (at most 8)
+#define OS_TASK_LEVELS              4
+
+//! Number of tasks that can be pending on each level
+#define OS_TASK_QUEUE_SIZE          8
+
+//! Priority of the process that runs the tasks
+#define OS_TASK_PRIORITY            4
+
+//! Size of the stack all tasks share
+#define OS_TASK_STACK_SIZE          STACK_SIZE_PROC
+
+//----------------------------------------------------------------------------
+// Trace constants
+//----------------------------------------------------------------------------
+
+/*!
+ *  If set to 1, context switches, process starts, blocking and critical
+ *  sections are recorded and sent over USART0 (PD1). This takes over the
+ *  USART0 data register empty interrupt. The trace is decoded by
+ *  SPOS/tools/trace_decode.py.
+ */
+#ifndef OS_TRACE
+#define OS_TRACE                    0
+#endif
+
+//! Baud rate of the trace, F_CPU / 16 has to be a multiple of it
+#define OS_TRACE_BAUD               250000ul
+
+//! Size of the buffer for events that wait to be sent (power of two, at most 128)
+#ifndef OS_TRACE_BUFFER_SIZE
+#define OS_TRACE_BUFFER_SIZE        128
+#endif
+
 //----------------------------------------------------------------------------
 // Stack constants
 //----------------------------------------------------------------------------
@@ -68,11 +227,34 @@
 //! The stack size available for initialization and globals
 #define STACK_SIZE_MAIN             32
 
-//! The scheduler's stack size
+//! The scheduler's stack size (it holds the task manager unless OS_TASKMAN_PROCESS)
+#if OS_TASKMAN_PROCESS
+#define STACK_SIZE_ISR              128
+#else
 #define STACK_SIZE_ISR              192
+#endif
+
+//! The share of every process in the half of the SRAM that holds the stacks
+#define STACK_SIZE_PROC_SHARE       (((AVR_MEMORY_SRAM / 2) - STACK_SIZE_MAIN - STACK_SIZE_ISR) / MAX_NUMBER_OF_PROCESSES)
 
-//! The stack size of a process
-#define STACK_SIZE_PROC             (((AVR_MEMORY_SRAM / 2) - STACK_SIZE_MAIN - STACK_SIZE_ISR) / MAX_NUMBER_OF_PROCESSES)
+//! The smallest stack a process may request (initial context, canary and one nested ISR)
+#define STACK_SIZE_PROC_MIN         80
+
+/*!
+ *  The stack size of a process that does not request a size of its own.
+ *  With many processes the share is too small for a process, so fewer of
+ *  them fit into the stack pool at the same time.
+ */
+#define STACK_SIZE_PROC             (STACK_SIZE_PROC_SHARE < STACK_SIZE_PROC_MIN ? STACK_SIZE_PROC_MIN : STACK_SIZE_PROC_SHARE)
+
+/*!
+ *  The memory for all process stacks. Stacks of the requested size are
+ *  taken from it when a process is started. Memory that is not needed for
+ *  stacks can be handed to the internal heap by lowering this.
+ */
+#ifndef STACK_POOL_SIZE
+#define STACK_POOL_SIZE             (MAX_NUMBER_OF_PROCESSES * STACK_SIZE_PROC_SHARE)
+#endif
 
 //! The bottom of the main stack. That is the highest address.
 #define BOTTOM_OF_MAIN_STACK        (AVR_SRAM_LAST)
@@ -83,8 +265,50 @@
 //! The bottom of the memory chunks for all process stacks. That is the highest address.
 #define BOTTOM_OF_PROCS_STACK       (BOTTOM_OF_ISR_STACK - STACK_SIZE_ISR)
 
-//! The bottom of the memory chunk with number PID.
-#define PROCESS_STACK_BOTTOM(PID)   (BOTTOM_OF_PROCS_STACK - ((PID) * STACK_SIZE_PROC))
+//! The limit of the memory for all process stacks. That is the lowest address.
+#define STACK_POOL_START            (BOTTOM_OF_PROCS_STACK - STACK_POOL_SIZE + 1)
+
+//----------------------------------------------------------------------------
+// Stack integrity constants
+//----------------------------------------------------------------------------
+
+//! Checksum only the occupied part of a stack (saved SP up to the bottom)
+#define STACK_CHECK_LIVE            0
+
+//! Compare a guard word at the stack limit instead of computing a checksum
+#define STACK_CHECK_CANARY          1
+
+//! Checksum the whole memory chunk of a stack (slow, meant for debugging)
+#define STACK_CHECK_FULL            2
+
+/*!
+ *  Selects how the scheduler verifies the stack of a process on every switch.
+ *  Regardless of the mode, a saved stack pointer beyond the limit of its
+ *  chunk is reported as an overflow.
+ */
+#ifndef STACK_CHECK_MODE
+#define STACK_CHECK_MODE            STACK_CHECK_CANARY
+#endif
+
+//! The guard word that is placed at the limit of each stack in canary mode
+#define STACK_CANARY                0x5A3C
+
+/*!
+ *  If set to 1, the stack of every new process is painted with
+ *  STACK_PAINT_PATTERN. The idle process scans one chunk of a stack per
+ *  iteration for the deepest byte that lost the pattern and records the
+ *  peak stack usage of each process. The task manager shows it on the
+ *  process stack page.
+ */
+#ifndef OS_STACK_WATERMARK
+#define OS_STACK_WATERMARK          0
+#endif
+
+//! The byte that unused stack memory is painted with
+#define STACK_PAINT_PATTERN         0xA5
+
+//! The number of bytes the idle process scans per iteration
+#define STACK_SCAN_CHUNK            16
 
 
 #endif
@@ -0,0 +1,213 @@
+#include "format.h"
+
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+/*! \file
+ *
+ *  A replacement for vfprintf in the output path. Only integers are
+ *  supported, which keeps the code small and fast. Decimal conversions use
+ *  16 bit divisions as soon as the remaining value fits, as 32 bit divisions
+ *  are expensive on the AVR.
+ *
+ *  fmt_printf_P understands the following conversions:
+ *    %d %i   signed decimal
+ *    %u      unsigned decimal
+ *    %x %X   hexadecimal (upper case digits)
+ *    %c      character
+ *    %s      string in RAM
+ *    %S      string in the program flash memory
+ *    %%      a literal %
+ *  A conversion may have a '0' flag and a field width (e.g. %04x) and an 'l'
+ *  length modifier for 32 bit arguments (e.g. %lu).
+ */
+
+/*!
+ *  Writes an unsigned number right-aligned in a field of the given width.
+ *
+ *  \param sink Receives the output.
+ *  \param value The number to write.
+ *  \param base 10 or 16, any other base is treated as 10.
+ *  \param width Minimum number of characters to write.
+ *  \param pad Character used to fill the field (usually ' ' or '0').
+ */
+void fmt_unsigned(FormatSink* sink, uint32_t value, uint8_t base, uint8_t width, char pad) {
+    // Enough digits for a 32 bit number in base 10
+    char digits[10];
+    uint8_t count = 0;
+    if (base == 16) {
+        do {
+            uint8_t const nibble = value & 0xF;
+            digits[count++] = (nibble < 10) ? '0' + nibble : 'A' - 10 + nibble;
+            value >>= 4;
+        } while (value);
+    } else {
+        while (value > 0xFFFF) {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        }
+        uint16_t small = value;
+        do {
+            digits[count++] = '0' + small % 10;
+            small /= 10;
+        } while (small);
+    }
+    while (width > count) {
+        sink(pad);
+        width--;
+    }
+    while (count) {
+        sink(digits[--count]);
+    }
+}
+
+/*!
+ *  Writes a signed decimal number right-aligned in a field of the given
+ *  width. With '0' as padding the sign precedes the zeros.
+ *
+ *  \param sink Receives the output.
+ *  \param value The number to write.
+ *  \param width Minimum number of characters to write, including the sign.
+ *  \param pad Character used to fill the field.
+ */
+void fmt_signed(FormatSink* sink, int32_t value, uint8_t width, char pad) {
+    uint32_t magnitude = value;
+    if (value < 0) {
+        magnitude = -magnitude;
+        if (pad == '0') {
+            sink('-');
+        } else {
+            // Count the digits so the sign ends up right in front of them
+            uint8_t digits = 1;
+            for (uint32_t rest = magnitude; rest >= 10; rest /= 10) {
+                digits++;
+            }
+            while (width > digits + 1) {
+                sink(pad);
+                width--;
+            }
+            sink('-');
+        }
+        if (width) {
+            width--;
+        }
+    }
+    fmt_unsigned(sink, magnitude, 10, width, pad);
+}
+
+/*!
+ *  Writes a fixed-point number, e.g. 1234 with 3 decimals as "1.234".
+ *
+ *  \param sink Receives the output.
+ *  \param value The number in units of 10^-decimals.
+ *  \param decimals Number of decimal places (at most 9).
+ */
+void fmt_fixed(FormatSink* sink, int32_t value, uint8_t decimals) {
+    uint32_t divisor = 1;
+    for (uint8_t i = 0; i < decimals; i++) {
+        divisor *= 10;
+    }
+    uint32_t magnitude = value;
+    if (value < 0) {
+        magnitude = -magnitude;
+        sink('-');
+    }
+    fmt_unsigned(sink, magnitude / divisor, 10, 0, ' ');
+    if (decimals) {
+        sink('.');
+        fmt_unsigned(sink, magnitude % divisor, 10, decimals, '0');
+    }
+}
+
+/*!
+ *  Writes a zero-terminated string from the program flash memory.
+ *
+ *  \param sink Receives the output.
+ *  \param string The string to write.
+ */
+void fmt_progString(FormatSink* sink, char const* string) {
+    char c;
+    while ((c = (char)pgm_read_byte(string++))) {
+        sink(c);
+    }
+}
+
+/*!
+ *  Formats the arguments according to a format string in the program flash
+ *  memory. See the top of this file for the supported conversions.
+ *
+ *  \param sink Receives the output.
+ *  \param format The format string in the program flash memory.
+ */
+void fmt_printf_P(FormatSink* sink, char const* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fmt_vprintf_P(sink, format, args);
+    va_end(args);
+}
+
+/*!
+ *  Formats a va_list according to a format string in the program flash
+ *  memory. Unknown conversions are written as they are.
+ *
+ *  \param sink Receives the output.
+ *  \param format The format string in the program flash memory.
+ *  \param args The arguments.
+ */
+void fmt_vprintf_P(FormatSink* sink, char const* format, va_list args) {
+    char c;
+    while ((c = (char)pgm_read_byte(format++))) {
+        if (c != '%') {
+            sink(c);
+            continue;
+        }
+        char pad = ' ';
+        uint8_t width = 0;
+        bool longArg = false;
+        c = (char)pgm_read_byte(format++);
+        if (c == '0') {
+            pad = '0';
+            c = (char)pgm_read_byte(format++);
+        }
+        while (c >= '0' && c <= '9') {
+            width = width * 10 + (c - '0');
+            c = (char)pgm_read_byte(format++);
+        }
+        if (c == 'l') {
+            longArg = true;
+            c = (char)pgm_read_byte(format++);
+        }
+        switch (c) {
+            case 'd':
+            case 'i':
+                fmt_signed(sink, longArg ? va_arg(args, int32_t) : va_arg(args, int), width, pad);
+                break;
+            case 'u':
+                fmt_unsigned(sink, longArg ? va_arg(args, uint32_t) : va_arg(args, unsigned), 10, width, pad);
+                break;
+            case 'x':
+            case 'X':
+                fmt_unsigned(sink, longArg ? va_arg(args, uint32_t) : va_arg(args, unsigned), 16, width, pad);
+                break;
+            case 'c':
+                sink((char)va_arg(args, int));
+                break;
+            case 's': {
+                char const* string = va_arg(args, char const*);
+                while (*string) {
+                    sink(*string++);
+                }
+                break;
+            }
+            case 'S':
+                fmt_progString(sink, va_arg(args, char const*));
+                break;
+            case '\0':
+                // The format string ends with a single %
+                return;
+            default:
+                sink(c);
+                break;
+        }
+    }
+}
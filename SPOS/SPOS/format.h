@@ -0,0 +1,44 @@
+/*! \file
+ *  \brief Small integer formatter.
+ *
+ *  Decimal, hexadecimal, fixed-point and padded output of integers, as well
+ *  as a printf-like function with format strings in the program flash
+ *  memory. Unlike vfprintf no floating point support is linked in.
+ */
+
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include <stdint.h>
+#include <stdarg.h>
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! Receives the formatted output one character at a time (e.g. lcd_writeChar)
+typedef void FormatSink(char character);
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Writes an unsigned number in base 10 or 16, padded to width
+void fmt_unsigned(FormatSink* sink, uint32_t value, uint8_t base, uint8_t width, char pad);
+
+//! Writes a signed decimal number, padded to width
+void fmt_signed(FormatSink* sink, int32_t value, uint8_t width, char pad);
+
+//! Writes value / 10^decimals with exactly the given number of decimal places
+void fmt_fixed(FormatSink* sink, int32_t value, uint8_t decimals);
+
+//! Writes a string from the program flash memory
+void fmt_progString(FormatSink* sink, char const* string);
+
+//! printf-like output with the format string in the program flash memory
+void fmt_printf_P(FormatSink* sink, char const* format, ...);
+
+//! Like fmt_printf_P, but takes a va_list
+void fmt_vprintf_P(FormatSink* sink, char const* format, va_list args);
+
+#endif
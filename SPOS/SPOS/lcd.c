@@ -11,9 +11,13 @@
  */
 
 #include "lcd.h"
+#include "format.h"
 #ifdef VERSUCH
     #include "util.h"
 #endif
+#if LCD_FRAMEBUFFER
+    #include "os_scheduler.h"
+#endif
 
 #pragma GCC push_options
 #pragma GCC optimize ("O3")
@@ -32,6 +36,44 @@
  */
 uint8_t charCtr;
 
+#if LCD_ASYNC
+
+//! Queued transfers, each holding the two bytes passed to lcd_sendStream
+static uint8_t lcd_queue[LCD_QUEUE_SIZE][2];
+
+//! Index of the oldest queued transfer
+static uint8_t lcd_queueHead = 0;
+
+//! Number of queued transfers
+static volatile uint8_t lcd_queueCount = 0;
+
+//! Number of times the busy flag was found set for the oldest transfer
+static uint16_t lcd_busyPolls = 0;
+
+#endif
+
+#if LCD_FRAMEBUFFER
+
+//! Value of lcd_address if the address counter of the LCD is not known
+#define LCD_ADDRESS_UNKNOWN 0xFF
+
+//! The characters that were written, one per cell (0-15 line 1, 16-31 line 2)
+static char lcd_frame[32] = "                                ";
+
+//! One bit per cell that has to be sent to the LCD
+static uint8_t lcd_dirty[4];
+
+//! The cell the address counter of the LCD points to
+static uint8_t lcd_address = LCD_ADDRESS_UNKNOWN;
+
+//! The process flushing the framebuffer (INVALID_PROCESS before it runs)
+static ProcessID lcd_flusherPid = INVALID_PROCESS;
+
+static void lcd_storeCell(uint8_t cell, char character);
+static void lcd_autoFlush(void);
+
+#endif
+
 /*!
  *  Internally used to turn on LCD Pin EN (Enable) for 1us.
  *  \internal
@@ -87,13 +129,19 @@ void lcd_init(void) {
     lcd_registerCustomChar(LCD_CC_MU,         LCD_CC_MU_BITMAP);
 
     lcd_clear();
+#if LCD_FRAMEBUFFER
+    // The framebuffer starts out blank, the display has to match it
+    lcd_command(LCD_CLEAR);
+#endif
 }
 
 /*!
  *  Moves the cursor to the first character of the first line of the LCD.
  */
 void lcd_line1(void) {
+#if !LCD_FRAMEBUFFER
     lcd_command(LCD_LINE_1);
+#endif
     charCtr = 0;
 }
 
@@ -101,7 +149,9 @@ void lcd_line1(void) {
  *  Moves the cursor to the first character of the second line of the LCD.
  */
 void lcd_line2(void) {
+#if !LCD_FRAMEBUFFER
     lcd_command(LCD_LINE_2);
+#endif
     charCtr = 16;
 }
 
@@ -150,56 +200,87 @@ void lcd_goto(unsigned char row, unsigned char column) {
         column = 0;
     }
 
-    // Calculate position and get command
-    char command = LCD_CURSOR_MOVE_R + column + row * LCD_NEXT_ROW;
-
     // Update char counter
     charCtr = row * 16 + column;
 
+#if !LCD_FRAMEBUFFER
+    // Calculate position and get command
+    char command = LCD_CURSOR_MOVE_R + column + row * LCD_NEXT_ROW;
+
     lcd_command(command);
+#endif
 }
 
 /*!
- *  Sends a stream to the LCD. The stream is a two-char pair which either
- *  holds a command or a printable char.
- *  This function is used by lcd_command and lcd_writeChar.
+ *  Reads the busy flag of the LCD once.
+ *  \internal
+ *
+ *  \return True iff the LCD is still busy with the previous transfer.
+ */
+static bool lcd_readBusy(void) {
+    // Read busy flag state:
+    // Set R/W port to high, all others to low
+    LCD_PORT_DATA = 0x40;
+
+    // Set enable port to high to read first nibble
+    sbi(LCD_PORT_DATA, 5);
+
+    // Enable reading from pins 1 to 4
+    LCD_PORT_DDR = 0xF0;
+
+    // Set pull-ups
+    LCD_PORT_DATA |= 0x0F;
+
+    // Read busy flag (port 4) and store state to 'busy'
+    bool const busy = LCD_PIN & 0x08;
+
+    // Set enable port back to low
+    cbi(LCD_PORT_DATA, 5);
+
+    // Second nibble is not used, waste it by calling lcd_enable
+    lcd_enable();
+
+    return busy;
+}
+
+/*!
+ *  Transmits a stream to the LCD, which has to be ready for it.
+ *  \internal
  *
  *  \param firstByte The first value to send.
  *  \param secondByte The second value to send.
  */
-void lcd_sendStream(uint8_t firstByte, uint8_t secondByte) {
+static void lcd_transmit(uint8_t firstByte, uint8_t secondByte) {
+    // Transmit command:
+    LCD_PORT_DDR = 0xFF;
+
+    // Send first Byte
+    LCD_PORT_DATA = firstByte;
+    lcd_enable();
+
+    // Send second Byte
+    LCD_PORT_DATA = secondByte;
+    lcd_enable();
+}
+
+/*!
+ *  Sends a stream to the LCD after waiting for it to become ready. The
+ *  busy flag is polled with interrupts disabled.
+ *  \internal
+ *
+ *  \param firstByte The first value to send.
+ *  \param secondByte The second value to send.
+ */
+static void lcd_sendStreamSync(uint8_t firstByte, uint8_t secondByte) {
     // Check if interrupts are set and store that state
     uint8_t sreg = SREG & (1 << 7);
 
     // Interrupts off
     cli();
     uint16_t iterations = 0;
-    bool busy = false;
 
     // Wait while LCD is busy or timeout was reached
-    do {
-        // Read busy flag state:
-        // Set R/W port to high, all others to low
-        LCD_PORT_DATA = 0x40;
-
-        // Set enable port to high to read first nibble
-        sbi(LCD_PORT_DATA, 5);
-
-        // Enable reading from pins 1 to 4
-        LCD_PORT_DDR = 0xF0;
-
-        // Set pull-ups
-        LCD_PORT_DATA |= 0x0F;
-
-        // Read busy flag (port 4) and store state to 'busy'
-        busy = LCD_PIN & 0x08;
-
-        // Set enable port back to low
-        cbi(LCD_PORT_DATA, 5);
-
-        // Second nibble is not used, waste it by calling lcd_enable
-        lcd_enable();
-
+    while (lcd_readBusy()) {
         // Increase count of iterations
         iterations++;
         if (iterations == LCD_BUSY_TIMEOUT) {
@@ -210,23 +291,112 @@ void lcd_sendStream(uint8_t firstByte, uint8_t secondByte) {
             SREG |= sreg;
             return;
         }
-    } while (busy);
-
-    // Transmit command:
-    LCD_PORT_DDR = 0xFF;
-
-    // Send first Byte
-    LCD_PORT_DATA = firstByte;
-    lcd_enable();
+    }
 
-    // Send second Byte
-    LCD_PORT_DATA = secondByte;
-    lcd_enable();
+    lcd_transmit(firstByte, secondByte);
 
     // Restore interrupt flag
     SREG |= sreg;
 }
 
+#if LCD_ASYNC
+
+/*!
+ *  Sends all queued transfers synchronously. Has to be called with
+ *  interrupts disabled.
+ *  \internal
+ */
+static void lcd_drainQueue(void) {
+    while (lcd_queueCount) {
+        lcd_sendStreamSync(lcd_queue[lcd_queueHead][0], lcd_queue[lcd_queueHead][1]);
+        lcd_queueHead = (lcd_queueHead + 1) & (LCD_QUEUE_SIZE - 1);
+        lcd_queueCount--;
+    }
+    lcd_busyPolls = 0;
+}
+
+/*!
+ *  Appends a stream to the transfer queue and starts the transport
+ *  interrupt. If interrupts are disabled nobody could empty the queue, so
+ *  everything is sent right away. A full queue is waited for.
+ *  \internal
+ *
+ *  \param firstByte The first value to send.
+ *  \param secondByte The second value to send.
+ */
+static void lcd_queueStream(uint8_t firstByte, uint8_t secondByte) {
+    for (;;) {
+        uint8_t const sreg = SREG & (1 << 7);
+        cli();
+        if (!sreg) {
+            lcd_drainQueue();
+            lcd_sendStreamSync(firstByte, secondByte);
+            return;
+        }
+        if (lcd_queueCount < LCD_QUEUE_SIZE) {
+            uint8_t const tail = (lcd_queueHead + lcd_queueCount) & (LCD_QUEUE_SIZE - 1);
+            lcd_queue[tail][0] = firstByte;
+            lcd_queue[tail][1] = secondByte;
+            lcd_queueCount++;
+            if (!(TIMSK0 & (1 << OCIE0B))) {
+                OCR0B = TCNT0 + LCD_ASYNC_INTERVAL;
+                TIFR0 = 1 << OCF0B;
+                sbi(TIMSK0, OCIE0B);
+            }
+            SREG |= sreg;
+            return;
+        }
+        // Let the transport interrupt make room
+        SREG |= sreg;
+    }
+}
+
+/*!
+ *  The asynchronous transport. Every interrupt polls the busy flag once and
+ *  sends the oldest queued transfer if the LCD is ready. The interrupt stops
+ *  itself once the queue is empty.
+ */
+ISR(TIMER0_COMPB_vect) {
+    if (lcd_queueCount) {
+        if (!lcd_readBusy()) {
+            lcd_transmit(lcd_queue[lcd_queueHead][0], lcd_queue[lcd_queueHead][1]);
+            lcd_queueHead = (lcd_queueHead + 1) & (LCD_QUEUE_SIZE - 1);
+            lcd_queueCount--;
+            lcd_busyPolls = 0;
+        } else if (++lcd_busyPolls == LCD_BUSY_TIMEOUT) {
+            // Timeout: Try to reset LCD and drop the transfer
+            lcd_enable();
+            lcd_queueHead = (lcd_queueHead + 1) & (LCD_QUEUE_SIZE - 1);
+            lcd_queueCount--;
+            lcd_busyPolls = 0;
+        }
+    }
+    if (lcd_queueCount) {
+        OCR0B = TCNT0 + LCD_ASYNC_INTERVAL;
+    } else {
+        cbi(TIMSK0, OCIE0B);
+    }
+}
+
+#endif
+
+/*!
+ *  Sends a stream to the LCD. The stream is a two-char pair which either
+ *  holds a command or a printable char.
+ *  This function is used by lcd_command and lcd_writeChar.
+ *  With LCD_ASYNC the stream is queued and the function returns at once.
+ *
+ *  \param firstByte The first value to send.
+ *  \param secondByte The second value to send.
+ */
+void lcd_sendStream(uint8_t firstByte, uint8_t secondByte) {
+#if LCD_ASYNC
+    lcd_queueStream(firstByte, secondByte);
+#else
+    lcd_sendStreamSync(firstByte, secondByte);
+#endif
+}
+
 /*!
  *  Sends a specific command to the LCD. This function is only used
  *  internally. There is no need to explicitly call it as its functionality is
@@ -236,6 +406,10 @@ void lcd_sendStream(uint8_t firstByte, uint8_t secondByte) {
  *  \internal
  */
 void lcd_command(uint8_t command) {
+#if LCD_FRAMEBUFFER
+    // The command may move the address counter
+    lcd_address = LCD_ADDRESS_UNKNOWN;
+#endif
     lcd_sendStream((command >> 4) & 0xF, command & 0xF);
 }
 
@@ -320,11 +494,18 @@ void lcd_writeChar(char character) {
         }
         #undef REMAP
 
+#if LCD_FRAMEBUFFER
+        lcd_storeCell(charCtr, character);
+#else
         lcd_sendStream(0x10 | ((character & 0xF0) >> 4), 0x10 | (character & 0x0F));
+#endif
 
         // Update char counter ... Do not modulo it down! we need it to become 32
         charCtr++;
     }
+#if LCD_FRAMEBUFFER
+    lcd_autoFlush();
+#endif
 }
 
 /*!
@@ -332,7 +513,14 @@ void lcd_writeChar(char character) {
  */
 void lcd_clear(void) {
     charCtr = 0;
+#if LCD_FRAMEBUFFER
+    for (uint8_t cell = 0; cell < 32; cell++) {
+        lcd_storeCell(cell, ' ');
+    }
+    lcd_autoFlush();
+#else
     lcd_command(LCD_CLEAR);
+#endif
 }
 
 /*!
@@ -385,8 +573,7 @@ void lcd_writeHexNibble(uint8_t number) {
  *  \param number  The number to be written.
  */
 void lcd_writeHexByte(uint8_t number) {
-    lcd_writeHexNibble(number >> 4);
-    lcd_writeHexNibble(number & 0xF);
+    fmt_unsigned(lcd_writeChar, number, 16, 2, '0');
 }
 
 /*!
@@ -395,8 +582,7 @@ void lcd_writeHexByte(uint8_t number) {
  *  \param number  The number to be written.
  */
 void lcd_writeHexWord(uint16_t number) {
-    lcd_writeHexByte(number >> 8);
-    lcd_writeHexByte(number);
+    fmt_unsigned(lcd_writeChar, number, 16, 4, '0');
 }
 
 /*!
@@ -405,41 +591,38 @@ void lcd_writeHexWord(uint16_t number) {
  * \param number The number to be written.
  */
 void lcd_writeHex(uint16_t number) {
-    if (!number) {
-        lcd_writeChar('0');
-        return;
-    }
-
-    uint16_t nib = 16;
-    uint8_t print = 0;
-    // Iterate over all nibbles and start printing when we find the first non-zero
-    while (nib) {
-        nib -= 4;
-        print |= number >> nib;
-        if (print) {
-            lcd_writeHexNibble(number >> nib);
-        }
-    }
+    fmt_unsigned(lcd_writeChar, number, 16, 0, '0');
 }
 
 /*!
  *  Writes a 16 bit integer as a decimal number without leading 0s
  */
 void lcd_writeDec(uint16_t number) {
-    if (!number) {
-        lcd_writeChar('0');
-        return;
-    }
+    fmt_unsigned(lcd_writeChar, number, 10, 0, ' ');
+}
 
-    uint32_t pos = 10000;
-    uint8_t print = 0;
-    do {
-        uint8_t const digit = number / pos;
-        number -= digit * pos;
-        if (print |= digit) {
-            lcd_writeChar(digit + '0');
-        }
-    } while (pos /= 10);
+/*!
+ *  Writes formatted integers and strings to the LCD. The format string lies
+ *  in the program flash memory, see format.c for the supported conversions.
+ *  Unlike printf this does not use vfprintf.
+ *
+ *  \param format The format string (e.g. PSTR("%u/%u")).
+ */
+void lcd_printf_P(char const* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fmt_vprintf_P(lcd_writeChar, format, args);
+    va_end(args);
+}
+
+/*!
+ *  Writes a fixed-point number, e.g. 1234 with 3 decimals as "1.234".
+ *
+ *  \param value The number in units of 10^-decimals.
+ *  \param decimals Number of decimal places.
+ */
+void lcd_writeFixed(int32_t value, uint8_t decimals) {
+    fmt_fixed(lcd_writeChar, value, decimals);
 }
 
 /*!
@@ -488,10 +671,7 @@ void lcd_drawBar(uint8_t percent) {
  */
 
 void lcd_writeProgString(char const* string) {
-    char c;
-    while ((c = (char)pgm_read_byte(string++))) {
-        lcd_writeChar(c);
-    }
+    fmt_progString(lcd_writeChar, string);
 }
 
 /*!
@@ -501,7 +681,8 @@ void lcd_writeProgString(char const* string) {
  *  \param string  The string to be written (a pointer to the first character).
  */
 void lcd_writeErrorProgString(char const* string) {
-    fprintf_P(stderr, string);
+    // The stream may be replaced (e.g. by tests), so the text has to go through it
+    fputs_P(string, stderr);
 }
 
 /*!
@@ -532,12 +713,95 @@ void lcd_registerCustomChar(uint8_t addr, uint64_t chr) {
 *  \param number is the number to write
 */
 void lcd_write32bitHex(uint32_t number) {
-    lcd_writeDec(0);
-    lcd_writeChar('x');
-    lcd_writeHexWord(number >> 16);
-    lcd_writeHexWord(number);
+    lcd_writeProgString(PSTR("0x"));
+    fmt_unsigned(lcd_writeChar, number, 16, 8, '0');
+}
+
+#if LCD_FRAMEBUFFER
+
+/*!
+ *  Writes a character into the framebuffer. The cell only has to be sent to
+ *  the LCD if the character differs from the one stored before.
+ *
+ *  \param cell The cell to write (0-15 line 1, 16-31 line 2).
+ *  \param character The character as it is sent to the LCD.
+ */
+static void lcd_storeCell(uint8_t cell, char character) {
+    uint8_t const sreg = SREG & (1 << 7);
+    cli();
+    if (lcd_frame[cell] != character) {
+        lcd_frame[cell] = character;
+        lcd_dirty[cell >> 3] |= 1 << (cell & 7);
+    }
+    SREG |= sreg;
 }
 
+/*!
+ *  Flushes the framebuffer right away if the flusher process cannot run,
+ *  i.e. if interrupts or preemption are disabled or if the flusher was
+ *  not started (yet).
+ */
+static void lcd_autoFlush(void) {
+    if (lcd_flusherPid == INVALID_PROCESS
+        || os_getProcessSlot(lcd_flusherPid)->state == OS_PS_UNUSED
+        || !(SREG & (1 << 7))
+        || !os_isPreemptible()) {
+        lcd_flush();
+    }
+}
+
+/*!
+ *  Sends every cell of the framebuffer that changed since the last flush to
+ *  the LCD. The address counter of the LCD advances on its own, so a cursor
+ *  command is only sent at the start of a run of changed cells. Each cell is
+ *  sent atomically, so flushes may interrupt each other.
+ */
+void lcd_flush(void) {
+    for (uint8_t cell = 0; cell < 32; cell++) {
+        if (!(lcd_dirty[cell >> 3] & (1 << (cell & 7)))) {
+            continue;
+        }
+        uint8_t const sreg = SREG & (1 << 7);
+        cli();
+        // Check again, an interrupting flush may have sent the cell already
+        if (lcd_dirty[cell >> 3] & (1 << (cell & 7))) {
+            lcd_dirty[cell >> 3] &= ~(1 << (cell & 7));
+            if (lcd_address != cell) {
+                uint8_t const command = LCD_CURSOR_MOVE_R + (cell & 0xF) + (cell >> 4) * LCD_NEXT_ROW;
+                lcd_sendStream((command >> 4) & 0xF, command & 0xF);
+            }
+            char const character = lcd_frame[cell];
+            lcd_sendStream(0x10 | ((character & 0xF0) >> 4), 0x10 | (character & 0x0F));
+            // The address counter does not wrap from line 1 to line 2
+            lcd_address = ((cell & 0xF) != 0xF) ? cell + 1 : LCD_ADDRESS_UNKNOWN;
+        }
+        SREG |= sreg;
+    }
+}
+
+/*!
+ *  Low priority process that sends the framebuffer to the LCD.
+ */
+REGISTER_AUTOSTART(lcd_flusher)
+void lcd_flusher(void) {
+    lcd_flusherPid = os_getCurrentProc();
+    os_getProcessSlot(lcd_flusherPid)->priority = LCD_FLUSH_PRIORITY;
+    for (;;) {
+        lcd_flush();
+        os_sleep(LCD_FLUSH_PERIOD);
+    }
+}
+
+#else
+
+/*!
+ *  Without a framebuffer every character is sent right away.
+ */
+void lcd_flush(void) {
+}
+
+#endif
+
 /*! \brief Prints the passed voltage onto the display (three float places).
  *
  * \param voltage           Binary voltage value.
@@ -545,24 +809,9 @@ void lcd_write32bitHex(uint32_t number) {
  * \param voltUpperBound    Upper bound of the float voltage value (i.e. 5 for 5V).
  */
 void lcd_writeVoltage(uint16_t voltage, uint16_t valueUpperBound, uint8_t voltUpperBound) {
-    uint8_t  intVal;
-    uint16_t floatVal;
-
-    // Calculate integer and float part of the voltage
-    voltage *= voltUpperBound;
-    intVal   = voltage / valueUpperBound;
-    floatVal = (uint32_t)(voltage - (intVal * valueUpperBound)) * 1000 / valueUpperBound;
-
-    // Show voltage on display
-    lcd_writeDec(intVal);
-    lcd_writeChar('.');
-    if (floatVal < 100) {
-        lcd_writeChar('0');
-    }
-    if (floatVal < 10) {
-        lcd_writeChar('0');
-    }
-    lcd_writeDec(floatVal);
+    // Calculate the voltage in mV and show it with three decimal places
+    uint32_t const millivolts = (uint32_t)voltage * voltUpperBound * 1000 / valueUpperBound;
+    lcd_writeFixed(millivolts, 3);
     lcd_writeChar('V');
 }
 
@@ -116,6 +116,46 @@
 //! Timeout for the busy signal of the LCD
 #define LCD_BUSY_TIMEOUT 2000
 
+/*!
+ *  If set to 1, all output goes to a shadow framebuffer in RAM. A low
+ *  priority process sends the cells that changed to the LCD. While
+ *  interrupts or the scheduler are disabled, the output is sent at once.
+ *  Requires SPOS, as the framebuffer is flushed by a process.
+ */
+#ifndef LCD_FRAMEBUFFER
+#define LCD_FRAMEBUFFER 0
+#endif
+
+#if LCD_FRAMEBUFFER && SPOS_CONFIG == 0
+    #error "The LCD framebuffer needs the scheduler of SPOS"
+#endif
+
+/*!
+ *  If set to 1, transfers to the LCD are queued and clocked out by the
+ *  compare B interrupt of timer 0, which polls the busy flag once per
+ *  interrupt instead of spinning. While interrupts are disabled, the queue
+ *  is emptied and the transfer is sent at once. Requires the timers of SPOS.
+ */
+#ifndef LCD_ASYNC
+#define LCD_ASYNC 0
+#endif
+
+#if LCD_ASYNC && SPOS_CONFIG == 0
+    #error "The asynchronous LCD transport needs timer 0 of SPOS"
+#endif
+
+//! Number of transfers that can be queued (a power of two)
+#define LCD_QUEUE_SIZE 32
+
+//! Timer 0 counts (12.8 us each) between two interrupts of the asynchronous transport
+#define LCD_ASYNC_INTERVAL 3
+
+//! Interval (in ms) at which the framebuffer is sent to the LCD
+#define LCD_FLUSH_PERIOD 20
+
+//! Priority of the process that flushes the framebuffer
+#define LCD_FLUSH_PRIORITY 1
+
 //----------------------------------------------------------------------------
 // Macros
 //----------------------------------------------------------------------------
@@ -251,12 +291,21 @@ void lcd_writeErrorProgString(const char* string);
 //! Write a draw bar
 void lcd_drawBar(uint8_t percent);
 
+//! Send the changed cells of the framebuffer to the LCD
+void lcd_flush(void);
+
 //! Register a custom designed character with the LCD.
 void lcd_registerCustomChar(uint8_t addr, uint64_t chr);
 
 //! Write a 32 bit number
 void lcd_write32bitHex(uint32_t number);
 
+//! Write formatted integers, the format string lies in the program flash memory
+void lcd_printf_P(char const* format, ...);
+
+//! Write a fixed-point number with the given number of decimal places
+void lcd_writeFixed(int32_t value, uint8_t decimals);
+
 //! Write a voltage with valueUpperBound as float voltage with voltUpperBound
 void lcd_writeVoltage(uint16_t voltage, uint16_t valueUpperBound, uint8_t voltUpperBound);
 
@@ -3,6 +3,8 @@
 #include "util.h"
 #include "lcd.h"
 #include "os_input.h"
+#include "os_trace.h"
+#include "os_memheap_drivers.h"
 
 #include <stdio.h>
 #include <avr/interrupt.h>
@@ -91,7 +93,7 @@ void os_init_timer(void) {
     sbi(TCCR2B, CS21); // Prescaler 1024  1
     sbi(TCCR2B, CS20); // Prescaler 1024  1
     sbi(TIMSK2, OCIE2A); // Enable interrupt
-    OCR2A = 60;
+    OCR2A = DEFAULT_TICK_PERIOD;
 
     // Init timer 0 with prescaler 256
     cbi(TCCR0B, CS00);
@@ -112,6 +114,9 @@ void os_init(void) {
     // Init buttons
     os_initInput();
 
+    // Init the event trace
+    os_initTrace();
+
     // Init LCD display
     lcd_init();
     stdout = lcdout;
@@ -121,6 +126,9 @@ void os_init(void) {
     os_checkResetSource(OS_ALLOWED_RESET_SOURCES);
     delayMs(DEFAULT_OUTPUT_DELAY * 20);
 
+    // Init the memory devices and heaps
+    os_initHeaps();
+
     os_initScheduler();
 
     os_systemTime_reset();
@@ -135,6 +143,7 @@ void os_errorPStr(char const* str) {
 	lcd_clear();
     lcd_writeErrorProgString(str);
 	SREG &= 0b01111111; //Disable interrupts
+	lcd_flush(); // The flusher process cannot run anymore
 	while(os_getInput() != 9){
 	}
 	os_waitForNoInput();
@@ -1,6 +1,8 @@
 #include "os_input.h"
+#include "os_scheduler.h"
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <stdint.h>
 
 /*! \file
@@ -9,6 +11,37 @@ Everything that is necessary to get the input from the Buttons in a clean format
 
 */
 
+#if OS_INPUT_EVENTS
+
+//! The buttons chosen to open the task manager (first and last)
+#define TASKMAN_CHORD 0b1001
+
+//! Queued input events
+static InputEvent eventQueue[INPUT_EVENT_QUEUE_SIZE];
+
+//! Index of the oldest queued event
+static uint8_t eventHead = 0;
+
+//! Number of queued events
+static uint8_t eventCount = 0;
+
+//! Processes that are blocked until an event arrives
+static ProcessSet eventWaiters = 0;
+
+//! The debounced state of the buttons
+static uint8_t stableInput = 0;
+
+//! Timer 0 overflows until the buttons are sampled again (0 if not debouncing)
+static uint8_t debounceTicks = 0;
+
+//! Set when the task manager chord was pressed
+static volatile bool taskManRequested = false;
+
+//! Called on the first edge of every debouncing, NULL if there is none
+static PinChangeHook* pinChangeHook = NULL;
+
+#endif
+
 /*!
  *  A simple "Getter"-Function for the Buttons on the evaluation board.\n
  *
@@ -29,22 +62,183 @@ uint8_t os_getInput(void) {
 void os_initInput() {
     DDRC &= 0b00111100;
     PORTC |= 0b11000011;
+#if OS_INPUT_EVENTS
+    stableInput = os_getInput();
+    // PC0, PC1, PC6 and PC7 are PCINT16, PCINT17, PCINT22 and PCINT23
+    PCMSK2 = (1 << PCINT16) | (1 << PCINT17) | (1 << PCINT22) | (1 << PCINT23);
+    PCIFR = 1 << PCIF2;
+    PCICR |= 1 << PCIE2;
+#endif
+}
+
+/*!
+ *  Gives the processor to other processes while waiting for a button.
+ *  This is only possible if a process waits with interrupts enabled, e.g.
+ *  the task manager and error messages wait with interrupts disabled.
+ */
+static void os_inputPause(void) {
+    if (SREG & (1 << SREG_I)) {
+        os_yield();
+    }
 }
 
 /*!
- *  Endless loop as long as at least one button is pressed.
+ *  Waits as long as at least one button is pressed.
  */
 void os_waitForNoInput() {
     while(os_getInput()!=0){
-
+        os_inputPause();
     }
 }
 
 /*!
- *  Endless loop until at least one button is pressed.
+ *  Waits until at least one button is pressed.
  */
 void os_waitForInput() {
     while(os_getInput()==0){
+        os_inputPause();
+    }
+}
+
+#if OS_INPUT_EVENTS
+
+/*!
+ *  Any edge on one of the buttons starts the debouncing. Further edges are
+ *  ignored until the buttons were sampled after INPUT_DEBOUNCE_TICKS. The
+ *  pin change hook is chained, as programs cannot have their own ISR.
+ */
+ISR(PCINT2_vect) {
+    PCICR &= ~(1 << PCIE2);
+    debounceTicks = INPUT_DEBOUNCE_TICKS;
+    if (pinChangeHook) {
+        pinChangeHook();
+    }
+}
+
+/*!
+ *  Sets the function that is called from the pin change ISR of the buttons.
+ *  It runs with interrupts disabled, so it has to be short. Edges during the
+ *  debouncing do not call it.
+ *
+ *  \param hook The function to call or NULL to remove it.
+ */
+void os_setPinChangeHook(PinChangeHook* hook) {
+    uint8_t const sreg = SREG;
+    cli();
+    pinChangeHook = hook;
+    SREG = sreg;
+}
+
+/*!
+ *  Appends an event to the queue and wakes up all waiting processes. The
+ *  event is dropped if the queue is full.
+ *
+ *  \param button The button that changed.
+ *  \param pressed Whether the button was pressed.
+ */
+static void os_pushInputEvent(uint8_t button, bool pressed) {
+    if (eventCount < INPUT_EVENT_QUEUE_SIZE) {
+        uint8_t const tail = (eventHead + eventCount) % INPUT_EVENT_QUEUE_SIZE;
+        eventQueue[tail] = (InputEvent){.button = button, .pressed = pressed};
+        eventCount++;
+    }
+    for (ProcessID pid = 0; eventWaiters; pid++) {
+        if (eventWaiters & PROCESS_BIT(pid)) {
+            eventWaiters &= ~PROCESS_BIT(pid);
+            os_unblock(pid);
+        }
+    }
+}
+
+/*!
+ *  Counts down the debouncing time. Once it is over, the buttons are sampled
+ *  and every button that differs from the debounced state yields an event.
+ *  Is called with interrupts disabled from the timer 0 overflow ISR.
+ */
+void os_inputTick(void) {
+    if (!debounceTicks || --debounceTicks) {
+        return;
+    }
+    // Edges after this point trigger the pin change interrupt again
+    PCIFR = 1 << PCIF2;
+    PCICR |= 1 << PCIE2;
+    uint8_t const input = os_getInput();
+    uint8_t const changed = input ^ stableInput;
+    if (!changed) {
+        return;
+    }
+    stableInput = input;
+    for (uint8_t button = 1; button < 0x10; button <<= 1) {
+        if (changed & button) {
+            os_pushInputEvent(button, input & button);
+        }
+    }
+    if (input == TASKMAN_CHORD && (changed & input)) {
+        taskManRequested = true;
+    }
+}
+
+/*!
+ *  Takes the oldest event from the queue if there is one.
+ *
+ *  \param event Receives the event.
+ *  \return True iff an event was taken.
+ */
+bool os_getInputEvent(InputEvent* event) {
+    uint8_t const sreg = SREG;
+    cli();
+    bool const available = eventCount;
+    if (available) {
+        *event = eventQueue[eventHead];
+        eventHead = (eventHead + 1) % INPUT_EVENT_QUEUE_SIZE;
+        eventCount--;
+    }
+    SREG = sreg;
+    return available;
+}
 
+/*!
+ *  Waits for the next input event. The process is blocked in the meantime,
+ *  so it uses no processor time while no button changes.
+ *
+ *  \return The oldest queued event.
+ */
+InputEvent os_waitForInputEvent(void) {
+    InputEvent event;
+    uint8_t const sreg = SREG;
+    cli();
+    while (!os_getInputEvent(&event)) {
+        eventWaiters |= PROCESS_BIT(os_getCurrentProc());
+        os_block();
     }
+    SREG = sreg;
+    return event;
+}
+
+/*!
+ *  Discards all queued events and takes the current button state as the
+ *  debounced one. Used after the task manager, which reads the buttons
+ *  directly.
+ */
+void os_flushInputEvents(void) {
+    uint8_t const sreg = SREG;
+    cli();
+    eventCount = 0;
+    stableInput = os_getInput();
+    taskManRequested = false;
+    SREG = sreg;
+}
+
+/*!
+ *  Lets the scheduler check for the task manager chord without polling the
+ *  buttons on every tick.
+ *
+ *  \return True iff the chord was pressed since the last call.
+ */
+bool os_takeTaskManRequest(void) {
+    bool const requested = taskManRequested;
+    taskManRequested = false;
+    return requested;
 }
+
+#endif
@@ -12,6 +12,26 @@
 #define _OS_INPUT_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "defines.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+#if OS_INPUT_EVENTS
+
+//! A debounced change of a single button
+typedef struct {
+    uint8_t button;    //!< The button as a bit like in os_getInput
+    bool pressed;      //!< Whether the button was pressed or released
+} InputEvent;
+
+//! This is the type of a pin change hook (not the pointer to one!)
+typedef void PinChangeHook(void);
+
+#endif
 
 //----------------------------------------------------------------------------
 // Function headers
@@ -29,4 +49,26 @@ void os_waitForNoInput(void);
 //! Waits for at least one button to be pressed
 void os_waitForInput(void);
 
+#if OS_INPUT_EVENTS
+
+//! Takes the oldest input event without waiting
+bool os_getInputEvent(InputEvent* event);
+
+//! Blocks the current process until an input event is available
+InputEvent os_waitForInputEvent(void);
+
+//! Discards all queued input events
+void os_flushInputEvents(void);
+
+//! Returns and clears whether the task manager button chord was pressed
+bool os_takeTaskManRequest(void);
+
+//! Advances the debouncing, called on every timer 0 overflow
+void os_inputTick(void);
+
+//! Sets a function that is called from the pin change ISR of the buttons
+void os_setPinChangeHook(PinChangeHook* hook);
+
+#endif
+
 #endif
@@ -0,0 +1,131 @@
+#include "os_mem_drivers.h"
+#include "os_spi.h"
+#include "atmega644constants.h"
+#include "util.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/*! \file
+
+Memory drivers. The internal SRAM is accessed directly, the external SRAM
+through SPI. Each access to the external SRAM is one SPI transaction with
+interrupts disabled, so processes and ISRs may use it concurrently.
+
+*/
+
+//! Instructions of the 23LC1024
+#define EXT_SRAM_READ   0x03
+#define EXT_SRAM_WRITE  0x02
+#define EXT_SRAM_WRMR   0x01
+
+//! Mode register value for single byte transfers
+#define EXT_SRAM_MODE_BYTE 0x00
+
+/*!
+ *  The internal SRAM needs no initialization.
+ */
+static void intSRAM_init(void) {
+}
+
+/*!
+ *  \param addr The address to read.
+ *  \return The byte at the address.
+ */
+static MemValue intSRAM_read(MemAddr addr) {
+    return *(MemValue const*)addr;
+}
+
+/*!
+ *  \param addr The address to write.
+ *  \param value The byte to store.
+ */
+static void intSRAM_write(MemAddr addr, MemValue value) {
+    *(MemValue*)addr = value;
+}
+
+MemDriver intSRAM__ = {
+    .start = AVR_SRAM_START,
+    .size = AVR_MEMORY_SRAM,
+    .init = intSRAM_init,
+    .read = intSRAM_read,
+    .write = intSRAM_write
+};
+
+#if OS_EXTERNAL_SRAM
+
+/*!
+ *  Starts an instruction of the external SRAM that takes an address. The
+ *  upper byte of the 24 bit address is always 0.
+ *
+ *  \param instruction The instruction to send.
+ *  \param addr The address of the instruction.
+ */
+static void extSRAM_command(uint8_t instruction, MemAddr addr) {
+    cbi(PORTB, SPI_PIN_CS);
+    os_spi_send(instruction);
+    os_spi_send(0);
+    os_spi_send(addr >> 8);
+    os_spi_send(addr & 0xFF);
+}
+
+/*!
+ *  Sets up the SPI bus and switches the external SRAM to byte mode.
+ */
+static void extSRAM_init(void) {
+    os_spi_init();
+    uint8_t const sreg = SREG;
+    cli();
+    cbi(PORTB, SPI_PIN_CS);
+    os_spi_send(EXT_SRAM_WRMR);
+    os_spi_send(EXT_SRAM_MODE_BYTE);
+    sbi(PORTB, SPI_PIN_CS);
+    SREG = sreg;
+}
+
+/*!
+ *  \param addr The address to read.
+ *  \return The byte at the address.
+ */
+static MemValue extSRAM_read(MemAddr addr) {
+    uint8_t const sreg = SREG;
+    cli();
+    extSRAM_command(EXT_SRAM_READ, addr);
+    MemValue const value = os_spi_receive();
+    sbi(PORTB, SPI_PIN_CS);
+    SREG = sreg;
+    return value;
+}
+
+/*!
+ *  \param addr The address to write.
+ *  \param value The byte to store.
+ */
+static void extSRAM_write(MemAddr addr, MemValue value) {
+    uint8_t const sreg = SREG;
+    cli();
+    extSRAM_command(EXT_SRAM_WRITE, addr);
+    os_spi_send(value);
+    sbi(PORTB, SPI_PIN_CS);
+    SREG = sreg;
+}
+
+MemDriver extSRAM__ = {
+    .start = 0,
+    .size = 0xFFFF,
+    .init = extSRAM_init,
+    .read = extSRAM_read,
+    .write = extSRAM_write
+};
+
+#endif
+
+/*!
+ *  Initializes the internal and, if enabled, the external SRAM.
+ */
+void os_initMemoryDevices(void) {
+    intSRAM->init();
+#if OS_EXTERNAL_SRAM
+    extSRAM->init();
+#endif
+}
@@ -0,0 +1,58 @@
+/*! \file
+ *  \brief Memory drivers of the OS.
+ *
+ *  Uniform byte access to the internal SRAM and the external SPI SRAM.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_MEM_DRIVERS_H
+#define _OS_MEM_DRIVERS_H
+
+#include <stdint.h>
+
+#include "defines.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! An address in the memory of a driver
+typedef uint16_t MemAddr;
+
+//! The value of a single byte of memory
+typedef uint8_t MemValue;
+
+//! Functions and bounds of a memory device
+typedef struct {
+    MemAddr start;                                //!< First address of the device
+    uint16_t size;                                //!< Number of addressable bytes
+    void (*init)(void);                           //!< Prepares the device for access
+    MemValue (*read)(MemAddr addr);               //!< Reads a single byte
+    void (*write)(MemAddr addr, MemValue value);  //!< Writes a single byte
+} MemDriver;
+
+//----------------------------------------------------------------------------
+// Drivers
+//----------------------------------------------------------------------------
+
+//! The internal SRAM of the ATmega644
+extern MemDriver intSRAM__;
+#define intSRAM (&intSRAM__)
+
+#if OS_EXTERNAL_SRAM
+//! The 23LC1024 on the SPI bus, of which the lower 64 KB are used
+extern MemDriver extSRAM__;
+#define extSRAM (&extSRAM__)
+#endif
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Initializes all memory devices
+void os_initMemoryDevices(void);
+
+#endif
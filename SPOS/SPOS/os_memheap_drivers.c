@@ -0,0 +1,93 @@
+#include "os_memheap_drivers.h"
+#include "os_core.h"
+#include "defines.h"
+
+#include <avr/pgmspace.h>
+
+/*! \file
+
+Heaps. The bounds of every heap are set up at runtime, since the internal
+heap starts behind the globals, which the linker places. A third of every
+heap is the map, as the map needs half a byte per byte of the use area.
+
+*/
+
+//! First address behind the globals, provided by the linker
+extern char __heap_start;
+
+//! First address of the process stacks
+#define INT_HEAP_END (STACK_POOL_START)
+
+Heap intHeap__ = {
+    .driver = intSRAM,
+    .strategy = OS_MEM_FIRST,
+    .name = "Internal"
+};
+
+#if OS_EXTERNAL_SRAM
+Heap extHeap__ = {
+    .driver = extSRAM,
+    .strategy = OS_MEM_FIRST,
+    .name = "External"
+};
+#endif
+
+//! All heaps in the order the task manager lists them
+static Heap* const heapList[] = {
+    intHeap,
+#if OS_EXTERNAL_SRAM
+    extHeap,
+#endif
+};
+
+/*!
+ *  Splits the memory of a heap into map and use area and marks the whole
+ *  use area as free.
+ *
+ *  \param heap The heap to set up.
+ *  \param start The first address of the heap.
+ *  \param size The size of the heap in bytes.
+ */
+static void os_initHeap(Heap* heap, MemAddr start, uint16_t size) {
+    heap->mapStart = start;
+    heap->mapSize = size / 3;
+    heap->useStart = start + heap->mapSize;
+    heap->useSize = 2 * heap->mapSize;
+    heap->runCount = 0;
+    heap->indexEnd = heap->useStart;
+    heap->nextFit = heap->useStart;
+    for (MemAddr addr = heap->mapStart; addr < heap->useStart; addr++) {
+        heap->driver->write(addr, 0);
+    }
+}
+
+/*!
+ *  Initializes the memory devices and all heaps. The internal heap takes
+ *  the memory between the globals and the process stacks.
+ */
+void os_initHeaps(void) {
+    os_initMemoryDevices();
+    MemAddr const intStart = (MemAddr)&__heap_start;
+    if (intStart >= INT_HEAP_END) {
+        os_errorPStr(PSTR("No internal heap"));
+    }
+    os_initHeap(intHeap, intStart, INT_HEAP_END - intStart);
+#if OS_EXTERNAL_SRAM
+    os_initHeap(extHeap, extSRAM->start, extSRAM->size);
+#endif
+}
+
+/*!
+ *  \return The number of heaps.
+ */
+uint8_t os_getHeapListLength(void) {
+    return sizeof(heapList) / sizeof(heapList[0]);
+}
+
+/*!
+ *  \param index The index of the heap, starting at 0.
+ *  \return The heap or NULL if there is no heap with that index.
+ */
+Heap* os_lookupHeap(uint8_t index) {
+    return index < os_getHeapListLength() ? heapList[index] : NULL;
+}
@@ -0,0 +1,88 @@
+/*! \file
+ *  \brief Heaps of the OS.
+ *
+ *  Describes the heaps that live on the memory devices and how their memory
+ *  is split into the allocation map and the usable part.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_MEMHEAP_DRIVERS_H
+#define _OS_MEMHEAP_DRIVERS_H
+
+#include <stdint.h>
+
+#include "defines.h"
+#include "os_mem_drivers.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! The strategies to choose a free chunk for an allocation
+typedef enum AllocStrategy {
+    OS_MEM_FIRST,   //!< The first chunk that is large enough
+    OS_MEM_NEXT,    //!< The first chunk that is large enough after the last allocation
+    OS_MEM_BEST,    //!< The smallest chunk that is large enough
+    OS_MEM_WORST    //!< The largest chunk
+} AllocStrategy;
+
+//! A run of free bytes in the use area of a heap
+typedef struct {
+    MemAddr start;              //!< First address of the run
+    uint16_t length;            //!< Number of free bytes
+} FreeRun;
+
+/*!
+ *  A heap. Every byte of the use area has a nibble in the map: 0 if it is
+ *  free, the ID of the owner for the first byte of a chunk and 0xF for the
+ *  following bytes. The map entry of an even offset is the high nibble.
+ *
+ *  Every free run in front of indexEnd is kept in runs, sorted by address
+ *  and with its full length. Only the map behind that is read to find free
+ *  bytes.
+ */
+typedef struct {
+    MemDriver* driver;          //!< The device the heap is stored on
+    MemAddr mapStart;           //!< First address of the map
+    uint16_t mapSize;           //!< Size of the map in bytes
+    MemAddr useStart;           //!< First address of the use area
+    uint16_t useSize;           //!< Size of the use area in bytes
+    AllocStrategy strategy;     //!< How free chunks are chosen
+    FreeRun runs[OS_MEM_RUN_COUNT]; //!< The known free runs
+    uint8_t runCount;           //!< Number of entries of runs
+    MemAddr indexEnd;           //!< All free runs in front of this are known
+    MemAddr nextFit;            //!< Where next fit continues its search
+    char const* name;           //!< Name shown by the task manager
+} Heap;
+
+//----------------------------------------------------------------------------
+// Heaps
+//----------------------------------------------------------------------------
+
+//! The heap in the internal SRAM between the globals and the process stacks
+extern Heap intHeap__;
+#define intHeap (&intHeap__)
+
+#if OS_EXTERNAL_SRAM
+//! The heap in the external SRAM
+extern Heap extHeap__;
+#define extHeap (&extHeap__)
+#endif
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Initializes the memory devices and clears the maps of all heaps
+void os_initHeaps(void);
+
+//! Number of heaps
+uint8_t os_getHeapListLength(void);
+
+//! Returns the heap with the given index or NULL
+Heap* os_lookupHeap(uint8_t index);
+
+#endif
@@ -0,0 +1,445 @@
+#include "os_memory.h"
+#include "os_scheduler.h"
+#include "os_core.h"
+
+#include <avr/pgmspace.h>
+
+/*! \file
+
+Allocation on the heaps. Every heap keeps an index of up to OS_MEM_RUN_COUNT
+free runs, so searches and allocations work on the index instead of reading
+the map nibble by nibble. Runs are appended to the index when the map behind
+it is searched, and a free run that no longer fits drops the last entry,
+which makes the map behind it unknown again. Only the unknown part and the
+bytes of a chunk that is freed are ever read from the map. Every allocation
+takes the beginning of a run, so a run only ever shrinks at its front. Next
+fit additionally remembers where its last allocation ended.
+
+All functions that change a map run in a critical section.
+
+*/
+
+//! Map entry of a free byte
+#define MAP_FREE 0x0
+
+//! Map entry of every byte of a chunk but the first
+#define MAP_FOLLOW 0xF
+
+/*!
+ *  \param heap The heap.
+ *  \return The first address behind the use area.
+ */
+static MemAddr os_getUseEnd(Heap const* heap) {
+    return heap->useStart + heap->useSize;
+}
+
+/*!
+ *  Reads the map entry of a byte of the use area.
+ *
+ *  \param heap The heap.
+ *  \param addr An address in the use area.
+ *  \return The nibble of the address.
+ */
+static MemValue os_getMapEntry(Heap const* heap, MemAddr addr) {
+    uint16_t const offset = addr - heap->useStart;
+    MemValue const pair = heap->driver->read(heap->mapStart + offset / 2);
+    return (offset & 1) ? (pair & 0x0F) : (pair >> 4);
+}
+
+/*!
+ *  Writes the map entry of a byte of the use area.
+ *
+ *  \param heap The heap.
+ *  \param addr An address in the use area.
+ *  \param value The new nibble of the address.
+ */
+static void os_setMapEntry(Heap const* heap, MemAddr addr, MemValue value) {
+    uint16_t const offset = addr - heap->useStart;
+    MemAddr const mapAddr = heap->mapStart + offset / 2;
+    MemValue const pair = heap->driver->read(mapAddr);
+    if (offset & 1) {
+        heap->driver->write(mapAddr, (pair & 0xF0) | value);
+    } else {
+        heap->driver->write(mapAddr, (pair & 0x0F) | (value << 4));
+    }
+}
+
+/*!
+ *  Finds the first address of a chunk.
+ *
+ *  \param heap The heap.
+ *  \param addr An address in an allocated chunk.
+ *  \return The address of the first byte of that chunk.
+ */
+static MemAddr os_getChunkStart(Heap const* heap, MemAddr addr) {
+    while (addr > heap->useStart && os_getMapEntry(heap, addr) == MAP_FOLLOW) {
+        addr--;
+    }
+    return addr;
+}
+
+/*!
+ *  Finds the next run of free bytes.
+ *
+ *  \param heap The heap.
+ *  \param addr The address to start searching at.
+ *  \param length Receives the length of the run, 0 if there is none.
+ *  \return The first address of the run.
+ */
+static MemAddr os_findFreeRun(Heap const* heap, MemAddr addr, uint16_t* length) {
+    MemAddr const end = os_getUseEnd(heap);
+    while (addr < end && os_getMapEntry(heap, addr) != MAP_FREE) {
+        addr++;
+    }
+    MemAddr run = addr;
+    while (run < end && os_getMapEntry(heap, run) == MAP_FREE) {
+        run++;
+    }
+    *length = run - addr;
+    return addr;
+}
+
+/*!
+ *  Moves free runs from the unknown part of the map into the index until
+ *  the index is full or covers the whole use area.
+ *
+ *  \param heap The heap.
+ */
+static void os_extendIndex(Heap* heap) {
+    MemAddr const end = os_getUseEnd(heap);
+    while (heap->indexEnd < end && heap->runCount < OS_MEM_RUN_COUNT) {
+        uint16_t length;
+        MemAddr const start = os_findFreeRun(heap, heap->indexEnd, &length);
+        if (!length) {
+            heap->indexEnd = end;
+            break;
+        }
+        heap->runs[heap->runCount].start = start;
+        heap->runs[heap->runCount].length = length;
+        heap->runCount++;
+        heap->indexEnd = start + length;
+    }
+}
+
+/*!
+ *  Removes an entry from the index.
+ *
+ *  \param heap The heap.
+ *  \param index The entry to remove.
+ */
+static void os_removeRun(Heap* heap, uint8_t index) {
+    heap->runCount--;
+    for (uint8_t i = index; i < heap->runCount; i++) {
+        heap->runs[i] = heap->runs[i + 1];
+    }
+}
+
+/*!
+ *  Inserts a run into the index. If the index is full, the run with the
+ *  highest address is left out and the map from its start on becomes
+ *  unknown.
+ *
+ *  \param heap The heap.
+ *  \param index Where the run belongs in the sorted index.
+ *  \param start The first address of the run.
+ *  \param length The number of free bytes.
+ */
+static void os_insertRun(Heap* heap, uint8_t index, MemAddr start, uint16_t length) {
+    if (heap->runCount == OS_MEM_RUN_COUNT) {
+        if (index == heap->runCount) {
+            heap->indexEnd = start;
+            return;
+        }
+        heap->indexEnd = heap->runs[--heap->runCount].start;
+    }
+    for (uint8_t i = heap->runCount; i > index; i--) {
+        heap->runs[i] = heap->runs[i - 1];
+    }
+    heap->runs[index].start = start;
+    heap->runs[index].length = length;
+    heap->runCount++;
+}
+
+/*!
+ *  Marks a chunk as free and merges it with the free runs around it.
+ *
+ *  \param heap The heap.
+ *  \param start The first address of an allocated chunk.
+ */
+static void os_releaseChunk(Heap* heap, MemAddr start) {
+    MemAddr const end = os_getUseEnd(heap);
+    MemAddr addr = start;
+    do {
+        os_setMapEntry(heap, addr++, MAP_FREE);
+    } while (addr < end && os_getMapEntry(heap, addr) == MAP_FOLLOW);
+
+    uint8_t index = 0;
+    while (index < heap->runCount && heap->runs[index].start < start) {
+        index++;
+    }
+    bool const left = index && heap->runs[index - 1].start + heap->runs[index - 1].length == start;
+    if (!left && start >= heap->indexEnd) {
+        // The run lies in the unknown part and is found by the next search
+        return;
+    }
+    if (index < heap->runCount && heap->runs[index].start == addr) {
+        addr += heap->runs[index].length;
+        os_removeRun(heap, index);
+    } else if (addr >= heap->indexEnd) {
+        while (addr < end && os_getMapEntry(heap, addr) == MAP_FREE) {
+            addr++;
+        }
+        heap->indexEnd = addr;
+    }
+    if (left) {
+        heap->runs[index - 1].length = addr - heap->runs[index - 1].start;
+    } else {
+        os_insertRun(heap, index, start, addr - start);
+    }
+}
+
+//! Position of a search in the index and behind it in the map
+typedef struct {
+    uint8_t index;      //!< Next entry of the index
+    MemAddr addr;       //!< Where the map is searched when the index is done
+} RunCursor;
+
+/*!
+ *  Yields the free runs of a heap in order of their addresses: first the
+ *  indexed ones, then the ones found in the unknown part of the map.
+ *
+ *  \param heap The heap.
+ *  \param cursor The position of the search.
+ *  \param run Receives the next run.
+ *  \return Whether there is another run.
+ */
+static bool os_nextFreeRun(Heap const* heap, RunCursor* cursor, FreeRun* run) {
+    if (cursor->index < heap->runCount) {
+        *run = heap->runs[cursor->index++];
+        return true;
+    }
+    run->start = os_findFreeRun(heap, cursor->addr, &run->length);
+    cursor->addr = run->start + run->length;
+    return run->length != 0;
+}
+
+/*!
+ *  Chooses a free run with the strategy of the heap. Next fit takes the
+ *  first run behind its last allocation and starts over at the beginning
+ *  of the heap if there is none.
+ *
+ *  \param heap The heap.
+ *  \param size The number of bytes needed.
+ *  \return The first address of the run or 0 if there is none.
+ */
+static MemAddr os_selectChunk(Heap* heap, uint16_t size) {
+    os_extendIndex(heap);
+    RunCursor cursor = {0, heap->indexEnd};
+    FreeRun chosen = {0, 0};
+    FreeRun run;
+    while (os_nextFreeRun(heap, &cursor, &run)) {
+        if (run.length < size) {
+            continue;
+        }
+        switch (heap->strategy) {
+            case OS_MEM_NEXT:
+                if (run.start >= heap->nextFit) {
+                    return run.start;
+                }
+                if (!chosen.start) {
+                    chosen = run;
+                }
+                break;
+            case OS_MEM_BEST:
+                if (run.length == size) {
+                    return run.start;
+                }
+                if (!chosen.start || run.length < chosen.length) {
+                    chosen = run;
+                }
+                break;
+            case OS_MEM_WORST:
+                if (!chosen.start || run.length > chosen.length) {
+                    chosen = run;
+                }
+                break;
+            default:
+                return run.start;
+        }
+    }
+    return chosen.start;
+}
+
+/*!
+ *  Allocates a chunk that belongs to the current process. The idle process,
+ *  code that runs before the scheduler and processes whose ID does not fit
+ *  into a map entry cannot own memory.
+ *
+ *  \param heap The heap to allocate on.
+ *  \param size The number of bytes needed.
+ *  \return The first address of the chunk or 0 if the heap has no free
+ *          chunk of that size.
+ */
+MemAddr os_malloc(Heap* heap, uint16_t size) {
+    ProcessID const owner = os_getCurrentProc();
+    if (!size || owner == 0 || owner >= MAP_FOLLOW) {
+        return 0;
+    }
+    os_enterCriticalSection();
+    MemAddr const chunk = os_selectChunk(heap, size);
+    if (chunk) {
+        os_setMapEntry(heap, chunk, owner);
+        for (MemAddr addr = chunk + 1; addr < chunk + size; addr++) {
+            os_setMapEntry(heap, addr, MAP_FOLLOW);
+        }
+        for (uint8_t i = 0; i < heap->runCount; i++) {
+            if (heap->runs[i].start == chunk) {
+                if (heap->runs[i].length == size) {
+                    os_removeRun(heap, i);
+                } else {
+                    heap->runs[i].start += size;
+                    heap->runs[i].length -= size;
+                }
+                break;
+            }
+        }
+        heap->nextFit = chunk + size;
+    }
+    os_leaveCriticalSection();
+    return chunk;
+}
+
+/*!
+ *  Frees the chunk that contains the address. Freeing 0 has no effect.
+ *  Freeing a chunk of another process or a free byte is an error.
+ *
+ *  \param heap The heap the chunk was allocated on.
+ *  \param addr An address in the chunk.
+ */
+void os_free(Heap* heap, MemAddr addr) {
+    if (!addr) {
+        return;
+    }
+    os_enterCriticalSection();
+    if (addr < heap->useStart || addr >= os_getUseEnd(heap)) {
+        os_leaveCriticalSection();
+        os_errorPStr(PSTR("Free outside heap"));
+        return;
+    }
+    MemAddr const start = os_getChunkStart(heap, addr);
+    MemValue const owner = os_getMapEntry(heap, start);
+    if (owner == MAP_FREE || owner == MAP_FOLLOW) {
+        os_leaveCriticalSection();
+        os_errorPStr(PSTR("Free of free byte"));
+        return;
+    }
+    if (owner != os_getCurrentProc()) {
+        os_leaveCriticalSection();
+        os_errorPStr(PSTR("Foreign free"));
+        return;
+    }
+    os_releaseChunk(heap, start);
+    os_leaveCriticalSection();
+}
+
+/*!
+ *  Frees every chunk of a process, e.g. because it was killed.
+ *
+ *  \param heap The heap to clean up.
+ *  \param pid The process whose chunks are freed.
+ */
+void os_freeProcessMemory(Heap* heap, ProcessID pid) {
+    if (pid == MAP_FREE || pid >= MAP_FOLLOW) {
+        return;
+    }
+    os_enterCriticalSection();
+    MemAddr const end = os_getUseEnd(heap);
+    for (MemAddr addr = heap->useStart; addr < end; addr++) {
+        if (os_getMapEntry(heap, addr) == pid) {
+            os_releaseChunk(heap, addr);
+        }
+    }
+    os_leaveCriticalSection();
+}
+
+/*!
+ *  Forgets all known free runs, so the next search reads the whole map.
+ *  Needed after the map was written without this module, e.g. when the
+ *  task manager erased the heap.
+ *
+ *  \param heap The heap.
+ */
+void os_resetFreeRuns(Heap* heap) {
+    os_enterCriticalSection();
+    heap->runCount = 0;
+    heap->indexEnd = heap->useStart;
+    heap->nextFit = heap->useStart;
+    os_leaveCriticalSection();
+}
+
+/*!
+ *  \param heap The heap.
+ *  \return The size of its map in bytes.
+ */
+uint16_t os_getMapSize(Heap const* heap) {
+    return heap->mapSize;
+}
+
+/*!
+ *  \param heap The heap.
+ *  \return The size of its use area in bytes.
+ */
+uint16_t os_getUseSize(Heap const* heap) {
+    return heap->useSize;
+}
+
+/*!
+ *  \param heap The heap.
+ *  \return The first address of its map.
+ */
+MemAddr os_getMapStart(Heap const* heap) {
+    return heap->mapStart;
+}
+
+/*!
+ *  \param heap The heap.
+ *  \return The first address of its use area.
+ */
+MemAddr os_getUseStart(Heap const* heap) {
+    return heap->useStart;
+}
+
+/*!
+ *  \param heap The heap.
+ *  \param addr An address in the use area.
+ *  \return The size of the chunk that contains the address or 0 if the
+ *          address is free.
+ */
+uint16_t os_getChunkSize(Heap const* heap, MemAddr addr) {
+    if (addr < heap->useStart || addr >= os_getUseEnd(heap) || os_getMapEntry(heap, addr) == MAP_FREE) {
+        return 0;
+    }
+    MemAddr const end = os_getUseEnd(heap);
+    MemAddr next = os_getChunkStart(heap, addr) + 1;
+    uint16_t size = 1;
+    while (next < end && os_getMapEntry(heap, next++) == MAP_FOLLOW) {
+        size++;
+    }
+    return size;
+}
+
+/*!
+ *  \param heap The heap.
+ *  \param allocStrat The strategy for all following allocations.
+ */
+void os_setAllocationStrategy(Heap* heap, AllocStrategy allocStrat) {
+    heap->strategy = allocStrat;
+}
+
+/*!
+ *  \param heap The heap.
+ *  \return The strategy of the heap.
+ */
+AllocStrategy os_getAllocationStrategy(Heap const* heap) {
+    return heap->strategy;
+}
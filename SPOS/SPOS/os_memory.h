@@ -0,0 +1,58 @@
+/*! \file
+ *  \brief Dynamic memory of the OS.
+ *
+ *  Allocation and deallocation of chunks on the heaps. Every chunk belongs
+ *  to the process that allocated it and is freed when that process is
+ *  killed.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_MEMORY_H
+#define _OS_MEMORY_H
+
+#include <stdint.h>
+
+#include "os_memheap_drivers.h"
+#include "os_process.h"
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Allocates a chunk of the heap for the current process
+MemAddr os_malloc(Heap* heap, uint16_t size);
+
+//! Frees a chunk of the current process
+void os_free(Heap* heap, MemAddr addr);
+
+//! Frees all chunks of a process
+void os_freeProcessMemory(Heap* heap, ProcessID pid);
+
+//! Forgets the known free runs of a heap after its map was changed directly
+void os_resetFreeRuns(Heap* heap);
+
+//! Size of the map of a heap in bytes
+uint16_t os_getMapSize(Heap const* heap);
+
+//! Size of the use area of a heap in bytes
+uint16_t os_getUseSize(Heap const* heap);
+
+//! First address of the map of a heap
+MemAddr os_getMapStart(Heap const* heap);
+
+//! First address of the use area of a heap
+MemAddr os_getUseStart(Heap const* heap);
+
+//! Size of the chunk that contains the address, 0 if it is free
+uint16_t os_getChunkSize(Heap const* heap, MemAddr addr);
+
+//! Selects how the heap chooses free chunks
+void os_setAllocationStrategy(Heap* heap, AllocStrategy allocStrat);
+
+//! Returns how the heap chooses free chunks
+AllocStrategy os_getAllocationStrategy(Heap const* heap);
+
+#endif
@@ -0,0 +1,205 @@
+#include "os_pool.h"
+#include "os_scheduler.h"
+#include "os_core.h"
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+/*! \file
+
+Block pools. A pool takes a single chunk of the internal heap for all of its
+blocks when it is created. Free blocks are linked through their own memory,
+so taking and returning a block only moves the head of that list and takes
+the same short time in every case. This also works from ISRs. Since all
+blocks of a pool have the same size, the pool cannot fragment. Behind the
+blocks the chunk holds one bit per block that is set while the block is
+allocated, so returning a block twice is caught.
+
+*/
+
+//! All pools
+static Pool pools[OS_POOL_COUNT];
+
+/*!
+ *  Finds the allocation bit of a block.
+ *
+ *  \param p The pool.
+ *  \param index The index of the block.
+ *  \param mask Receives the mask of the bit within its byte.
+ *  \return The byte that holds the bit.
+ */
+static uint8_t* os_poolUsedBit(Pool const* p, uint8_t index, uint8_t* mask) {
+    *mask = 1 << (index & 7);
+    return (uint8_t*)(p->chunk + (uint16_t)p->count * p->blockSize) + index / 8;
+}
+
+/*!
+ *  Creates a pool that is owned by the current process. Blocks are at
+ *  least two bytes large to hold the link of the free list.
+ *
+ *  \param blockSize The size of a block in bytes.
+ *  \param count The number of blocks.
+ *  \return The ID of the pool or INVALID_POOL if there is no free pool or
+ *          not enough memory.
+ */
+PoolID os_poolCreate(uint16_t blockSize, uint8_t count) {
+    if (blockSize < sizeof(void*)) {
+        blockSize = sizeof(void*);
+    }
+    uint32_t const size = (uint32_t)blockSize * count + (count + 7) / 8;
+    if (!count || size > UINT16_MAX) {
+        return INVALID_POOL;
+    }
+    MemAddr const chunk = os_malloc(intHeap, size);
+    if (!chunk) {
+        return INVALID_POOL;
+    }
+    // Link all blocks, the last one ends the list
+    uint8_t* block = (uint8_t*)chunk;
+    for (uint8_t i = 1; i < count; i++, block += blockSize) {
+        *(void**)block = block + blockSize;
+    }
+    *(void**)block = NULL;
+    for (uint8_t i = 0; i < (count + 7) / 8; i++) {
+        ((uint8_t*)chunk)[(uint16_t)count * blockSize + i] = 0;
+    }
+
+    uint8_t const sreg = SREG;
+    cli();
+    PoolID id = 0;
+    while (id < OS_POOL_COUNT && pools[id].chunk) {
+        id++;
+    }
+    if (id < OS_POOL_COUNT) {
+        pools[id] = (Pool){
+            .chunk = chunk,
+            .freeList = (void*)chunk,
+            .blockSize = blockSize,
+            .count = count,
+            .owner = os_getCurrentProc()
+        };
+    }
+    SREG = sreg;
+    if (id == OS_POOL_COUNT) {
+        os_free(intHeap, chunk);
+        return INVALID_POOL;
+    }
+    return id;
+}
+
+/*!
+ *  Destroys a pool. Blocks that are still allocated must not be used any
+ *  more. Only the owner of the pool may destroy it.
+ *
+ *  \param pool The pool to destroy.
+ */
+void os_poolDestroy(PoolID pool) {
+    if (pool >= OS_POOL_COUNT) {
+        return;
+    }
+    uint8_t const sreg = SREG;
+    cli();
+    MemAddr const chunk = pools[pool].chunk;
+    if (!chunk) {
+        SREG = sreg;
+        return;
+    }
+    if (pools[pool].owner != os_getCurrentProc()) {
+        SREG = sreg;
+        os_errorPStr(PSTR("Pool not owned"));
+        return;
+    }
+    pools[pool].chunk = 0;
+    SREG = sreg;
+    os_free(intHeap, chunk);
+}
+
+/*!
+ *  Takes the first block of the free list. May be called from an ISR.
+ *
+ *  \param pool The pool to allocate from.
+ *  \return The block or NULL if all blocks are allocated.
+ */
+void* os_poolAlloc(PoolID pool) {
+    if (pool >= OS_POOL_COUNT) {
+        return NULL;
+    }
+    Pool* const p = &pools[pool];
+    uint8_t const sreg = SREG;
+    cli();
+    void* const block = p->chunk ? p->freeList : NULL;
+    if (block) {
+        uint8_t mask;
+        uint8_t* const used = os_poolUsedBit(p, ((MemAddr)block - p->chunk) / p->blockSize, &mask);
+        *used |= mask;
+        p->freeList = *(void**)block;
+        if (++p->used > p->peak) {
+            p->peak = p->used;
+        }
+    } else if (p->chunk) {
+        p->failures++;
+    }
+    SREG = sreg;
+    return block;
+}
+
+/*!
+ *  Puts a block in front of the free list. Any process may free a block.
+ *  May be called from an ISR. Addresses that are not the start of a block
+ *  and blocks that are not allocated are reported.
+ *
+ *  \param pool The pool the block was allocated from.
+ *  \param block The block to return, NULL is ignored.
+ */
+void os_poolFree(PoolID pool, void* block) {
+    if (!block) {
+        return;
+    }
+    Pool* const p = &pools[pool];
+    uint8_t const sreg = SREG;
+    cli();
+    if (pool >= OS_POOL_COUNT || !p->chunk || (MemAddr)block < p->chunk
+        || (MemAddr)block >= p->chunk + (uint16_t)p->count * p->blockSize
+        || ((MemAddr)block - p->chunk) % p->blockSize) {
+        SREG = sreg;
+        os_errorPStr(PSTR("Block not in pool"));
+        return;
+    }
+    uint8_t mask;
+    uint8_t* const used = os_poolUsedBit(p, ((MemAddr)block - p->chunk) / p->blockSize, &mask);
+    if (!(*used & mask)) {
+        SREG = sreg;
+        os_errorPStr(PSTR("Pool double free"));
+        return;
+    }
+    *used &= ~mask;
+    *(void**)block = p->freeList;
+    p->freeList = block;
+    p->used--;
+    SREG = sreg;
+}
+
+/*!
+ *  Marks the pools of a process as unused. Is called when the process is
+ *  killed, their chunks are freed with the rest of its memory.
+ *
+ *  \param pid The process whose pools are dropped.
+ */
+void os_freeProcessPools(ProcessID pid) {
+    uint8_t const sreg = SREG;
+    cli();
+    for (PoolID id = 0; id < OS_POOL_COUNT; id++) {
+        if (pools[id].owner == pid) {
+            pools[id].chunk = 0;
+        }
+    }
+    SREG = sreg;
+}
+
+/*!
+ *  \param pool The ID of the pool.
+ *  \return The pool or NULL if there is no pool with that ID.
+ */
+Pool const* os_lookupPool(PoolID pool) {
+    return (pool < OS_POOL_COUNT && pools[pool].chunk) ? &pools[pool] : NULL;
+}
@@ -0,0 +1,68 @@
+/*! \file
+ *  \brief Block pools of the OS.
+ *
+ *  Pools of equally sized blocks that are carved from the internal heap
+ *  and allocated and freed in constant time.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_POOL_H
+#define _OS_POOL_H
+
+#include <stdint.h>
+
+#include "defines.h"
+#include "os_memory.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! The type for the ID of a pool
+typedef uint8_t PoolID;
+
+//! ID that is returned if no pool could be created
+#define INVALID_POOL                255
+
+/*!
+ *  A pool. Its blocks lie in one chunk of the internal heap, the free ones
+ *  form a list through their first two bytes. The chunk ends with one
+ *  allocation bit per block.
+ */
+typedef struct {
+    MemAddr chunk;          //!< The chunk of the blocks (0 if the pool is unused)
+    void* freeList;         //!< The first free block
+    uint16_t blockSize;     //!< Size of a block in bytes
+    uint8_t count;          //!< Number of blocks
+    uint8_t used;           //!< Number of allocated blocks
+    uint8_t peak;           //!< Highest number of allocated blocks
+    uint16_t failures;      //!< Number of allocations that found no free block
+    ProcessID owner;        //!< The process that created the pool
+} Pool;
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Creates a pool of count blocks of blockSize bytes
+PoolID os_poolCreate(uint16_t blockSize, uint8_t count);
+
+//! Destroys a pool and frees its memory
+void os_poolDestroy(PoolID pool);
+
+//! Takes a free block of the pool
+void* os_poolAlloc(PoolID pool);
+
+//! Returns a block to its pool
+void os_poolFree(PoolID pool, void* block);
+
+//! Forgets the pools of a process, whose memory is freed anyway
+void os_freeProcessPools(ProcessID pid);
+
+//! Returns the pool with the given ID or NULL if it does not exist
+Pool const* os_lookupPool(PoolID pool);
+
+#endif
@@ -14,9 +14,25 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "defines.h"
+
 //! The type for the ID of a running process.
 typedef uint8_t ProcessID;
 
+//! A set of processes. Bit i is set iff the process with ID i is a member.
+#if MAX_NUMBER_OF_PROCESSES <= 8
+typedef uint8_t ProcessSet;
+#elif MAX_NUMBER_OF_PROCESSES <= 16
+typedef uint16_t ProcessSet;
+#elif MAX_NUMBER_OF_PROCESSES <= 32
+typedef uint32_t ProcessSet;
+#else
+#error "MAX_NUMBER_OF_PROCESSES must not exceed 32"
+#endif
+
+//! The set that only holds the process with the given ID.
+#define PROCESS_BIT(PID) ((ProcessSet)1 << (PID))
+
 //! This is the type of a program function (not the pointer to one!).
 typedef void Program(void);
 
@@ -37,6 +53,12 @@ typedef enum ProcessState {
     OS_PS_BLOCKED
 } ProcessState;
 
+//! Layout of the context that is saved on the stack of a suspended process.
+typedef enum ContextFrame {
+    OS_CF_FULL,  //!< SREG and all 32 registers, saved when the process is preempted
+    OS_CF_LIGHT  //!< SREG and the callee-saved registers only, saved when the process yields
+} ContextFrame;
+
 //! A union that holds the current stack pointer of a given process.
 //! We use a union so we can reduce the number of explicit casts.
 typedef union StackPointer {
@@ -55,6 +77,9 @@ typedef struct {
 	Priority priority;
 	StackPointer sp;
 	StackChecksum checksum;
+	ContextFrame frame;
+	uint16_t stackBottom;  //!< Highest address of the stack
+	uint16_t stackLimit;   //!< Lowest address of the stack
 } Process;
 
 /*!
@@ -64,6 +89,7 @@ typedef struct {
  */
 struct program_linked_list_node {
     Program *program;
+    uint16_t stackSize;    //!< Requested stack size, 0 for STACK_SIZE_PROC
     struct program_linked_list_node *next;
 };
 
@@ -90,9 +116,18 @@ extern struct program_linked_list_node *autostart_head;
  *    }
  */
 #define REGISTER_AUTOSTART(PROGRAM_FUNCTION) \
+    REGISTER_AUTOSTART_STACK(PROGRAM_FUNCTION, 0)
+
+/*!
+ *  Like REGISTER_AUTOSTART, but the process is started with a stack of
+ *  STACK_SIZE bytes instead of STACK_SIZE_PROC.
+ *
+ *    REGISTER_AUTOSTART_STACK(blinker, 96);
+ */
+#define REGISTER_AUTOSTART_STACK(PROGRAM_FUNCTION, STACK_SIZE) \
     Program PROGRAM_FUNCTION; \
     void __attribute__((constructor)) register_autostart_##PROGRAM_FUNCTION(void) { \
-        static struct program_linked_list_node node = { .program = PROGRAM_FUNCTION }; \
+        static struct program_linked_list_node node = { .program = PROGRAM_FUNCTION, .stackSize = (STACK_SIZE) }; \
         node.next = autostart_head; \
         autostart_head = &node; \
     }
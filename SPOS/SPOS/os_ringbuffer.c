@@ -0,0 +1,165 @@
+#include "os_ringbuffer.h"
+#include "os_scheduler.h"
+
+#include <avr/interrupt.h>
+#include <string.h>
+
+/*! \file
+
+Single producer, single consumer ring buffers. Indices are single bytes, so
+reading and writing them is atomic. The producer writes the record before it
+advances the head and the consumer reads the record before it advances the
+tail, so each side only ever sees complete records.
+Only the blocking functions disable interrupts, for checking the wait
+condition and blocking without losing a wakeup.
+
+*/
+
+//! Keeps the compiler from moving memory accesses across this point
+#define MEMORY_BARRIER() __asm__ volatile("" ::: "memory")
+
+/*!
+ *  Wakes up a process that waits on one side of the buffer.
+ *
+ *  \param waiter The waiting process (INVALID_PROCESS if none).
+ */
+static void os_ringBufferWake(ProcessID waiter) {
+    if (waiter != INVALID_PROCESS) {
+        os_unblock(waiter);
+    }
+}
+
+/*!
+ *  \param rb The buffer.
+ *  \return The number of records that can be popped.
+ */
+uint8_t os_ringBufferCount(RingBuffer const* rb) {
+    return (uint8_t)(rb->head - rb->tail);
+}
+
+/*!
+ *  \param rb The buffer.
+ *  \return The number of records that can be pushed.
+ */
+uint8_t os_ringBufferSpace(RingBuffer const* rb) {
+    return rb->mask + 1 - os_ringBufferCount(rb);
+}
+
+/*!
+ *  Copies a record into the buffer. May be called from an ISR. A consumer
+ *  that waits for data is woken up.
+ *
+ *  \param rb The buffer.
+ *  \param record The recordSize bytes to append.
+ *  \return False if the buffer was full and the record was dropped.
+ */
+bool os_ringBufferPush(RingBuffer* rb, void const* record) {
+    uint8_t const head = rb->head;
+    if ((uint8_t)(head - rb->tail) > rb->mask) {
+        return false;
+    }
+    memcpy(rb->data + (head & rb->mask) * rb->recordSize, record, rb->recordSize);
+    MEMORY_BARRIER();
+    rb->head = head + 1;
+    os_ringBufferWake(rb->consumer);
+    return true;
+}
+
+/*!
+ *  Copies the oldest record out of the buffer. May be called from an ISR.
+ *  A producer that waits for space is woken up.
+ *
+ *  \param rb The buffer.
+ *  \param record Receives recordSize bytes.
+ *  \return False if the buffer was empty.
+ */
+bool os_ringBufferPop(RingBuffer* rb, void* record) {
+    uint8_t const tail = rb->tail;
+    if (rb->head == tail) {
+        return false;
+    }
+    memcpy(record, rb->data + (tail & rb->mask) * rb->recordSize, rb->recordSize);
+    MEMORY_BARRIER();
+    rb->tail = tail + 1;
+    os_ringBufferWake(rb->producer);
+    return true;
+}
+
+/*!
+ *  Like os_ringBufferPush, but without the copy loop. The buffer must hold
+ *  records of one byte.
+ *
+ *  \param rb The buffer.
+ *  \param byte The byte to append.
+ *  \return False if the buffer was full and the byte was dropped.
+ */
+bool os_ringBufferPushByte(RingBuffer* rb, uint8_t byte) {
+    uint8_t const head = rb->head;
+    if ((uint8_t)(head - rb->tail) > rb->mask) {
+        return false;
+    }
+    rb->data[head & rb->mask] = byte;
+    MEMORY_BARRIER();
+    rb->head = head + 1;
+    os_ringBufferWake(rb->consumer);
+    return true;
+}
+
+/*!
+ *  Like os_ringBufferPop, but without the copy loop. The buffer must hold
+ *  records of one byte.
+ *
+ *  \param rb The buffer.
+ *  \param byte Receives the byte.
+ *  \return False if the buffer was empty.
+ */
+bool os_ringBufferPopByte(RingBuffer* rb, uint8_t* byte) {
+    uint8_t const tail = rb->tail;
+    if (rb->head == tail) {
+        return false;
+    }
+    *byte = rb->data[tail & rb->mask];
+    MEMORY_BARRIER();
+    rb->tail = tail + 1;
+    os_ringBufferWake(rb->producer);
+    return true;
+}
+
+/*!
+ *  Appends a record. While the buffer is full, the producing process is
+ *  blocked until the consumer pops a record. Must not be called from an ISR.
+ *
+ *  \param rb The buffer.
+ *  \param record The recordSize bytes to append.
+ */
+void os_ringBufferWaitPush(RingBuffer* rb, void const* record) {
+    uint8_t const sreg = SREG;
+    cli();
+    while (!os_ringBufferSpace(rb)) {
+        rb->producer = os_getCurrentProc();
+        os_block();
+    }
+    rb->producer = INVALID_PROCESS;
+    SREG = sreg;
+    os_ringBufferPush(rb, record);
+}
+
+/*!
+ *  Takes the oldest record. While the buffer is empty, the consuming
+ *  process is blocked until the producer pushes a record. Must not be
+ *  called from an ISR.
+ *
+ *  \param rb The buffer.
+ *  \param record Receives recordSize bytes.
+ */
+void os_ringBufferWaitPop(RingBuffer* rb, void* record) {
+    uint8_t const sreg = SREG;
+    cli();
+    while (!os_ringBufferCount(rb)) {
+        rb->consumer = os_getCurrentProc();
+        os_block();
+    }
+    rb->consumer = INVALID_PROCESS;
+    SREG = sreg;
+    os_ringBufferPop(rb, record);
+}
@@ -0,0 +1,86 @@
+/*! \file
+ *  \brief Ring buffers for passing data between processes and ISRs.
+ *
+ *  Single producer, single consumer ring buffers for bytes and records of
+ *  a fixed size that need neither critical sections nor disabled interrupts.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_RINGBUFFER_H
+#define _OS_RINGBUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "defines.h"
+#include "os_process.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+/*!
+ *  A ring buffer of records. The head is only written by the producer and
+ *  the tail only by the consumer. Both count up freely and wrap around at
+ *  256, their difference is the number of stored records.
+ */
+typedef struct {
+    uint8_t* data;                  //!< Storage for capacity records
+    uint8_t mask;                   //!< Capacity - 1, the capacity is a power of two
+    uint8_t recordSize;             //!< Size of a record in bytes
+    volatile uint8_t head;          //!< Number of records pushed so far
+    volatile uint8_t tail;          //!< Number of records popped so far
+    volatile ProcessID producer;    //!< Producer waiting for space (INVALID_PROCESS if none)
+    volatile ProcessID consumer;    //!< Consumer waiting for data (INVALID_PROCESS if none)
+} RingBuffer;
+
+/*!
+ *  Defines a ring buffer together with its storage.
+ *  The capacity has to be a power of two of at most 128.
+ *
+ *    RING_BUFFER(samples, 16, sizeof(uint16_t));
+ */
+#define RING_BUFFER(NAME, CAPACITY, RECORD_SIZE) \
+    typedef char NAME##_capacity_must_be_a_power_of_two_up_to_128[ \
+        ((CAPACITY) & ((CAPACITY) - 1)) || (CAPACITY) > 128 ? -1 : 1]; \
+    static uint8_t NAME##_data[(CAPACITY) * (RECORD_SIZE)]; \
+    RingBuffer NAME = { \
+        .data = NAME##_data, \
+        .mask = (CAPACITY) - 1, \
+        .recordSize = (RECORD_SIZE), \
+        .producer = INVALID_PROCESS, \
+        .consumer = INVALID_PROCESS \
+    }
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Number of records in the buffer
+uint8_t os_ringBufferCount(RingBuffer const* rb);
+
+//! Number of records that can be pushed without waiting
+uint8_t os_ringBufferSpace(RingBuffer const* rb);
+
+//! Appends a record if there is space (producer only)
+bool os_ringBufferPush(RingBuffer* rb, void const* record);
+
+//! Takes the oldest record if there is one (consumer only)
+bool os_ringBufferPop(RingBuffer* rb, void* record);
+
+//! Appends a byte to a buffer of one byte records (producer only)
+bool os_ringBufferPushByte(RingBuffer* rb, uint8_t byte);
+
+//! Takes a byte from a buffer of one byte records (consumer only)
+bool os_ringBufferPopByte(RingBuffer* rb, uint8_t* byte);
+
+//! Appends a record, blocks the producing process while the buffer is full
+void os_ringBufferWaitPush(RingBuffer* rb, void const* record);
+
+//! Takes a record, blocks the consuming process while the buffer is empty
+void os_ringBufferWaitPop(RingBuffer* rb, void* record);
+
+#endif
@@ -15,15 +15,36 @@
 #include "os_scheduling_strategies.h"
 #include "os_taskman.h"
 #include "os_core.h"
+#include "os_trace.h"
+#include "os_memory.h"
+#include "os_pool.h"
+#include "os_sync.h"
 #include "lcd.h"
 #include <stdlib.h>
+#include <string.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <stdbool.h>
 
 //----------------------------------------------------------------------------
 // Private Types
 //----------------------------------------------------------------------------
 
+/*!
+ *  The context a new process starts with, as it lies on its stack from the
+ *  initial stack pointer up to the bottom. The registers are popped by
+ *  restoreContext in this order, then the program is entered by reti. Since
+ *  the address of os_exitProcess lies below it, returning from the program
+ *  ends the process. Return addresses are stored with the high byte first.
+ */
+typedef struct {
+	uint8_t registers[33]; // r0 to r30, SREG, r31
+	uint8_t programHigh;
+	uint8_t programLow;
+	uint8_t exitHigh;
+	uint8_t exitLow;
+} InitialFrame;
+
 //----------------------------------------------------------------------------
 // Globals
 //----------------------------------------------------------------------------
@@ -31,9 +52,28 @@
 //! Array of states for every possible process
 Process os_processes[MAX_NUMBER_OF_PROCESSES];
 
+#if OS_SCHEDULER_STATS
+//! CPU time of every process in timer 0 counts
+Time os_processRuntime[MAX_NUMBER_OF_PROCESSES];
+
+//! Number of times every process was switched to
+uint16_t os_processSwitches[MAX_NUMBER_OF_PROCESSES];
+
+//! Timing of the process switches
+SchedulerStats os_schedulerStats;
+#endif
 
-//! Index of process that is currently executed (default: idle)
-uint8_t currentProcess = 0;
+#if OS_STACK_WATERMARK
+//! Deepest stack usage of every process in bytes, measured from the bottom of its stack
+uint16_t os_stackPeak[MAX_NUMBER_OF_PROCESSES];
+#endif
+
+/*!
+ *  Set of all processes that are READY or RUNNING. It is kept up to date by
+ *  os_exec, os_kill and the scheduler, such that the strategies never have to
+ *  walk os_processes[] to find candidates.
+ */
+ProcessSet os_readySet = 0;
 
 //! Contains the process id of the currently active process.
 ProcessID currentProc = 0;
@@ -42,12 +82,70 @@ ProcessID currentProc = 0;
 // Private variables
 //----------------------------------------------------------------------------
 
+#ifdef OS_FIXED_SCHEDULING_STRATEGY
+//! Currently active scheduling strategy (fixed at compile time)
+SchedulingStrategy actual = OS_FIXED_SCHEDULING_STRATEGY;
+#else
 //! Currently active scheduling strategy
 SchedulingStrategy actual;
 
+//! Implementation of every scheduling strategy
+static SchedulingStrategyFunction* strategyTable[OS_SS_COUNT] = {
+	[OS_SS_EVEN]              = os_Scheduler_Even,
+	[OS_SS_RANDOM]            = os_Scheduler_Random,
+	[OS_SS_RUN_TO_COMPLETION] = os_Scheduler_RunToCompletion,
+	[OS_SS_ROUND_ROBIN]       = os_Scheduler_RoundRobin,
+	[OS_SS_INACTIVE_AGING]    = os_Scheduler_InactiveAging,
+	[OS_SS_EDF]               = os_Scheduler_EDF,
+};
+#endif
+
 //! Count of currently nested critical sections
 uint8_t criticalSectionCount = 0;
 
+//! Set by the scheduler interrupt if it had to defer a process switch
+volatile bool os_reschedulePending = false;
+
+//! Regular length of a scheduler tick in timer 2 counts
+static uint8_t tickPeriod = DEFAULT_TICK_PERIOD;
+
+//! Time (in timer 0 counts) at which each sleeping process has to be woken up
+static Ticks wakeupTime[MAX_NUMBER_OF_PROCESSES];
+
+//! Successor of each sleeping process in the wakeup list
+static ProcessID wakeupNext[MAX_NUMBER_OF_PROCESSES];
+
+//! The sleeping process that has to be woken up first (INVALID_PROCESS if none)
+static ProcessID wakeupHead = INVALID_PROCESS;
+
+/*!
+ *  Set of all process slots that are in use, such that os_exec finds a
+ *  free slot without walking os_processes[]. The state of a slot has the
+ *  final say, though.
+ */
+static ProcessSet os_usedSet = 0;
+
+#if OS_SCHEDULER_STATS
+//! Timestamps and phase durations of the process switch in progress
+static struct {
+	Time start;
+	Time last;
+	uint16_t phase[OS_STAT_PHASE_COUNT];
+	bool discard;
+} statsSample;
+
+//! Time at which the current process was switched to
+static Time statsSwitchedIn;
+#endif
+
+#if OS_STACK_WATERMARK
+//! The process whose stack is scanned for the paint pattern
+static ProcessID stackScanPid = 0;
+
+//! The next address to scan, 0 if the scan has to start at the limit of the stack
+static uint16_t stackScanAddr = 0;
+#endif
+
 //----------------------------------------------------------------------------
 // Private function declarations
 //----------------------------------------------------------------------------
@@ -55,10 +153,85 @@ uint8_t criticalSectionCount = 0;
 //! ISR for timer compare match (scheduler)
 ISR(TIMER2_COMPA_vect) __attribute__((naked));
 
+//! Performs a voluntary process switch with a light context frame
+static void os_switchVoluntarily(void) __attribute__((naked, noinline));
+
+//! Selects the next process after the context of the current one was saved
+static void os_dispatch(void);
+
+//! Selects the process that will run after the current one
+static ProcessID os_selectNextProcess(void);
+
+//! Runs the active scheduling strategy
+static inline ProcessID os_callStrategy(void);
+
+#if OS_SCHEDULER_STATS
+//! Starts timing a process switch
+static void os_statsBegin(void);
+
+//! Finishes the timing of one phase of a process switch
+static void os_statsPhase(StatsPhase phase);
+
+//! Finishes timing a process switch and accounts it
+static void os_statsEnd(void);
+
+//! Excludes the process switch in progress from the statistics
+#define os_statsDiscard() (statsSample.discard = true)
+#else
+#define os_statsBegin()
+#define os_statsPhase(PHASE)
+#define os_statsEnd()
+#define os_statsDiscard()
+#endif
+
+//! Verifies the stack of a process that is about to be restored
+static void os_checkStack(ProcessID pid);
+
+//! Adapts the length of the next scheduler tick to the ready set
+static void os_adjustTick(void);
+
+//! Ends a stretched idle tick as soon as another process became ready
+static void os_restoreTick(void);
+
+//! Wakes up all sleeping processes that are due
+static void os_wakeSleepers(void);
+
+//! Removes a process from the wakeup list
+static void os_cancelWakeup(ProcessID pid);
+
+//! Finds room for a stack in the stack pool
+static uint16_t os_allocStack(uint16_t size);
+
+//! Finds an unused process slot
+static ProcessID os_findFreeSlot(void);
+
+//! Ends the process whose program returned
+static void os_exitProcess(void) __attribute__((noreturn));
+
+#if OS_STACK_WATERMARK
+//! Scans the next chunk of a process stack for the deepest used byte
+static void os_scanStackChunk(void);
+#endif
+
 //----------------------------------------------------------------------------
 // Function definitions
 //----------------------------------------------------------------------------
 
+/*!
+ *  Restores the context of the process currentProc according to the frame
+ *  its context was saved in. This has to be expanded inline at the end of a
+ *  naked function running on the scheduler stack, since it does not return.
+ */
+#define restoreCurrentProcess() do { \
+	if (os_processes[currentProc].frame == OS_CF_LIGHT) { \
+		SP = os_processes[currentProc].sp.as_int; \
+		restoreLightContext(); \
+	} else { \
+		SP = os_processes[currentProc].sp.as_int; \
+		restoreContext(); \
+	} \
+} while (0)
+
 /*!
  *  Timer interrupt that implements our scheduler. Execution of the running
  *  process is suspended and the context saved to the stack. Then the periphery
@@ -66,79 +239,430 @@ ISR(TIMER2_COMPA_vect) __attribute__((naked));
  *  for execution is derived with an exchangeable strategy. Finally the
  *  scheduler restores the next process for execution and releases control over
  *  the processor to that process.
+ *  If the running process disabled preemption, it is resumed right away and
+ *  the switch is marked as pending instead.
  */
 ISR(TIMER2_COMPA_vect) {
 	saveContext(); // 2
 	
-	os_processes[currentProcess].sp.as_int = SP; //3
+	os_processes[currentProc].sp.as_int = SP; //3
+	os_processes[currentProc].frame = OS_CF_FULL;
 	
 	SP = BOTTOM_OF_ISR_STACK; // 4 Scheduler Stack
 	
-	os_processes[currentProcess].checksum = os_getStackChecksum(currentProcess);
+	if (criticalSectionCount) {
+		// The switch is made as soon as preemption is enabled again
+		os_reschedulePending = true;
+	} else {
+		os_dispatch();
+	}
+	
+	restoreCurrentProcess(); // 8 & 9
+}
+
+/*!
+ *  The part of a process switch that is shared by the scheduler interrupt and
+ *  voluntary switches. It runs on the scheduler stack after the context of
+ *  the current process has been saved and leaves the process to restore in
+ *  currentProc.
+ */
+static void os_dispatch(void) {
+	os_reschedulePending = false;
+	os_statsBegin();
+	os_trace(OS_TE_SWITCH_OUT, currentProc);
+	
+	os_processes[currentProc].checksum = os_getStackChecksum(currentProc);
+	os_statsPhase(OS_STAT_CHECKSUM);
 	
-	if(os_getInput() == 9){ // Like F12 to BIOS
+#if OS_INPUT_EVENTS
+	bool const taskManRequested = os_takeTaskManRequest(); // Set by the debouncing instead of polling
+#else
+	bool const taskManRequested = os_getInput() == 9; // Like F12 to BIOS
+#endif
+#if OS_TASKMAN_PROCESS
+	if(taskManRequested){
+		os_requestTaskMan(); // The task manager runs in its own process
+	}
+#else
+	if(taskManRequested){
 		os_waitForNoInput();
 		os_taskManMain();
+#if OS_INPUT_EVENTS
+		os_flushInputEvents(); // The task manager consumed these buttons
+#endif
+		os_statsDiscard(); // The user would be timed as well
 	}
+#endif
+	os_statsPhase(OS_STAT_INPUT);
 	
-	os_processes[currentProcess].state = OS_PS_READY; // 5
-		
-	switch (os_getSchedulingStrategy()){ // 6&7
-	case OS_SS_EVEN:{
-		//currentProcess = os_Scheduler_Even(os_processes, currentProcess); Alternative
-		os_processes[os_Scheduler_Even(os_processes, currentProcess)].state = OS_PS_RUNNING;
-		break;
-	}
-	case OS_SS_RANDOM:{
-		//currentProcess = os_Scheduler_Random(os_processes, currentProcess); Alternative
-		os_processes[os_Scheduler_Random(os_processes, currentProcess)].state = OS_PS_RUNNING;
-		break;
-	}
-	case OS_SS_RUN_TO_COMPLETION:{
-		//currentProcess = os_Scheduler_RunToCompletion(os_processes, currentProcess); Alternative
-		os_processes[os_Scheduler_RunToCompletion(os_processes, currentProcess)].state = OS_PS_RUNNING;
-		break;
-	}
-	case OS_SS_ROUND_ROBIN:{
-		//currentProcess = os_Scheduler_RoundRobin(os_processes, currentProcess); Alternative
-		os_processes[os_Scheduler_RoundRobin(os_processes, currentProcess)].state = OS_PS_RUNNING;
-		break;
-	}
-	case OS_SS_INACTIVE_AGING:{
-		//currentProcess = os_Scheduler_InactiveAging(os_processes, currentProcess); Alternative
-		os_processes[os_Scheduler_InactiveAging(os_processes, currentProcess)].state = OS_PS_RUNNING;
-		break;
-	}
-	default: break;
-	}
-	// currentProcess.state = OS_PS_RUNNING; Alternative
+	// The current process may have been killed or blocked in the meantime
+	if(os_processes[currentProc].state == OS_PS_RUNNING){
+		os_processes[currentProc].state = OS_PS_READY; // 5
+	}
 	
-	SP = os_processes[currentProcess].sp.as_int; // 8
+	os_wakeSleepers();
 	
-	if(os_processes[currentProcess].checksum != os_getStackChecksum(currentProcess)){
-		os_errorPStr(PSTR("Checksum incorrect"));
+	currentProc = os_selectNextProcess(); // 6
+	os_processes[currentProc].state = OS_PS_RUNNING; // 7
+	os_statsPhase(OS_STAT_SELECT);
+	
+	os_adjustTick();
+	
+	os_checkStack(currentProc);
+	os_statsPhase(OS_STAT_STACK);
+	
+	os_statsEnd();
+	os_trace(OS_TE_SWITCH_IN, currentProc);
+}
+
+#if OS_SCHEDULER_STATS
+
+/*!
+ *  Takes the first timestamp of a process switch. The time since the
+ *  outgoing process was switched to is accounted as its CPU time.
+ */
+static void os_statsBegin(void) {
+	Time const now = os_systemTime_augment();
+	os_processRuntime[currentProc] += now - statsSwitchedIn;
+	statsSample.start = now;
+	statsSample.last = now;
+	statsSample.discard = false;
+}
+
+/*!
+ *  Stores the time since the previous timestamp as the duration of a phase.
+ *
+ *  \param phase The phase that just ended.
+ */
+static void os_statsPhase(StatsPhase phase) {
+	Time const now = os_systemTime_augment();
+	statsSample.phase[phase] = now - statsSample.last;
+	statsSample.last = now;
+}
+
+/*!
+ *  Adds the process switch that just ended to the statistics, unless it was
+ *  discarded, and starts accounting the CPU time of the incoming process.
+ */
+static void os_statsEnd(void) {
+	statsSwitchedIn = statsSample.last;
+	os_processSwitches[currentProc]++;
+	if (statsSample.discard) {
+		return;
+	}
+	uint16_t const latency = statsSample.last - statsSample.start;
+	if (latency < os_schedulerStats.minLatency) {
+		os_schedulerStats.minLatency = latency;
+	}
+	if (latency > os_schedulerStats.maxLatency) {
+		os_schedulerStats.maxLatency = latency;
+	}
+	os_schedulerStats.sumLatency += latency;
+	os_schedulerStats.switches++;
+	for (uint8_t phase = 0; phase < OS_STAT_PHASE_COUNT; phase++) {
+		os_schedulerStats.phase[phase] += statsSample.phase[phase];
+	}
+}
+
+/*!
+ *  Returns the timing of all process switches since the last reset.
+ *
+ *  \return A pointer to the statistics. They may change with every tick.
+ */
+SchedulerStats const* os_getSchedulerStats(void) {
+	return &os_schedulerStats;
+}
+
+/*!
+ *  Returns the CPU time of a process, not counting the process switches.
+ *
+ *  \param pid The process to look up.
+ *  \return The CPU time in timer 0 counts.
+ */
+Time os_getProcessRuntime(ProcessID pid) {
+	uint8_t const sreg = SREG;
+	cli();
+	Time const runtime = os_processRuntime[pid];
+	SREG = sreg;
+	return runtime;
+}
+
+/*!
+ *  Returns how often the scheduler switched to a process.
+ *
+ *  \param pid The process to look up.
+ *  \return The number of switches to the process.
+ */
+uint16_t os_getProcessSwitches(ProcessID pid) {
+	uint8_t const sreg = SREG;
+	cli();
+	uint16_t const switches = os_processSwitches[pid];
+	SREG = sreg;
+	return switches;
+}
+
+/*!
+ *  Clears the timing of the process switches and the CPU accounting of all
+ *  processes.
+ */
+void os_resetSchedulerStats(void) {
+	uint8_t const sreg = SREG;
+	cli();
+	os_schedulerStats = (SchedulerStats){.minLatency = UINT16_MAX};
+	for (ProcessID pid = 0; pid < MAX_NUMBER_OF_PROCESSES; pid++) {
+		os_processRuntime[pid] = 0;
+		os_processSwitches[pid] = 0;
 	}
+	statsSwitchedIn = os_systemTime_augment();
+	SREG = sreg;
+}
+
+#endif
+
+/*!
+ *  Entry of a voluntary process switch. As it is called like a function, only
+ *  a light context frame has to be saved. Afterwards the same path as the
+ *  scheduler interrupt is taken. The timer is reset, so the next process
+ *  starts with a full tick.
+ */
+static void os_switchVoluntarily(void) {
+	saveLightContext();
+	
+	os_processes[currentProc].sp.as_int = SP;
+	os_processes[currentProc].frame = OS_CF_LIGHT;
+	
+	SP = BOTTOM_OF_ISR_STACK;
 	
-	restoreContext(); // 9
+	TCNT2 = 0;
+	TIFR2 = 1 << OCF2A; // A pending tick would be redundant
+	
+	os_dispatch();
+	
+	restoreCurrentProcess();
+}
+
+/*!
+ *  Asks the active scheduling strategy for the next process. The ready set is
+ *  only a cache of the process states, so the choice is validated against the
+ *  state of the chosen slot. Should someone have modified os_processes[]
+ *  directly, the set is rebuilt once and the strategy is asked again.
+ *
+ *  \return The process that will be executed next.
+ */
+static ProcessID os_selectNextProcess(void) {
+	for(uint8_t attempt = 0; attempt < 2; attempt++){
+		ProcessID const next = os_callStrategy();
+		if(next < MAX_NUMBER_OF_PROCESSES && os_isRunnable(&os_processes[next])){
+			return next;
+		}
+		// Resynchronize the ready set with the process states
+		os_readySet = 0;
+		for(ProcessID pid = 0; pid < MAX_NUMBER_OF_PROCESSES; pid++){
+			if(os_isRunnable(&os_processes[pid])){
+				os_readySet |= PROCESS_BIT(pid);
+			}
+		}
+	}
+	return 0;
+}
+
+/*!
+ *  Runs the active scheduling strategy. With a fixed strategy the switch is
+ *  resolved by the compiler, leaving a direct call to that one strategy.
+ *  Otherwise the strategy is looked up in the strategy table.
+ *
+ *  \return The process the strategy selected.
+ */
+static inline ProcessID os_callStrategy(void) {
+#ifdef OS_FIXED_SCHEDULING_STRATEGY
+	switch (OS_FIXED_SCHEDULING_STRATEGY){
+	case OS_SS_EVEN:              return os_Scheduler_Even(os_processes, currentProc);
+	case OS_SS_RANDOM:            return os_Scheduler_Random(os_processes, currentProc);
+	case OS_SS_RUN_TO_COMPLETION: return os_Scheduler_RunToCompletion(os_processes, currentProc);
+	case OS_SS_ROUND_ROBIN:       return os_Scheduler_RoundRobin(os_processes, currentProc);
+	case OS_SS_INACTIVE_AGING:    return os_Scheduler_InactiveAging(os_processes, currentProc);
+	case OS_SS_EDF:               return os_Scheduler_EDF(os_processes, currentProc);
+	default:                      return 0;
+	}
+#else
+	return strategyTable[actual](os_processes, currentProc);
+#endif
+}
+
+/*!
+ *  Sets the compare value of timer 2 for the tick that starts now. While the
+ *  idle process is the only one that is ready, nothing can change until the
+ *  first sleeping process is due or an interrupt makes another process ready.
+ *  So the tick is stretched up to that wakeup, limited by the longest period
+ *  timer 2 supports. Otherwise the regular period is used.
+ */
+static void os_adjustTick(void) {
+#if OS_TICKLESS_IDLE
+	if (os_readySet == 1) {
+		uint8_t period = 0xFF;
+		if (wakeupHead != INVALID_PROCESS) {
+			int32_t const remaining = wakeupTime[wakeupHead] - os_ticks();
+			// Timer 2 counts once per 1024 / TC0_PRESCALER timer 0 counts, rounding down wakes up early rather than late
+			if (remaining < 0xFF * (1024 / TC0_PRESCALER)) {
+				period = (remaining >= 1024 / TC0_PRESCALER) ? remaining / (1024 / TC0_PRESCALER) : 1;
+			}
+		}
+		OCR2A = period;
+		return;
+	}
+#endif
+	OCR2A = tickPeriod;
+}
+
+/*!
+ *  Has to be called whenever a process other than idle becomes ready. If the
+ *  current tick was stretched, the regular period is restored so that the
+ *  new process is scheduled within one regular tick.
+ */
+static void os_restoreTick(void) {
+#if OS_TICKLESS_IDLE
+	if (OCR2A != tickPeriod) {
+		OCR2A = tickPeriod;
+		// The counter may already be past the new compare value
+		if (TCNT2 >= tickPeriod) {
+			TCNT2 = 0;
+		}
+	}
+#endif
+}
+
+/*!
+ *  Moves every sleeping process whose wakeup time has come from the head of
+ *  the wakeup list back into the ready set. As the list is sorted, only the
+ *  head has to be looked at when nobody is due.
+ */
+static void os_wakeSleepers(void) {
+	if (wakeupHead == INVALID_PROCESS) {
+		return;
+	}
+	Ticks const now = os_ticks();
+	while (wakeupHead != INVALID_PROCESS && TICKS_REACHED(now, wakeupTime[wakeupHead])) {
+		ProcessID const pid = wakeupHead;
+		wakeupHead = wakeupNext[pid];
+		os_unblock(pid);
+	}
+}
+
+/*!
+ *  Removes a process from the wakeup list, if it is a member.
+ *  Must be called with interrupts disabled.
+ *
+ *  \param pid The process that does not need to be woken up any more.
+ */
+static void os_cancelWakeup(ProcessID pid) {
+	ProcessID* link = &wakeupHead;
+	while (*link != INVALID_PROCESS) {
+		if (*link == pid) {
+			*link = wakeupNext[pid];
+			return;
+		}
+		link = &wakeupNext[*link];
+	}
 }
 
 /*!
  *  This is the idle program. The idle process owns all the memory
  *  and processor time no other process wants to have.
+ *  With OS_TICKLESS_IDLE, the MCU sleeps until the next interrupt.
+ *  With OS_STACK_WATERMARK, one chunk of a process stack is scanned for
+ *  its peak usage per iteration.
  */
 void idle(void) {
+#if OS_TICKLESS_IDLE
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	while(1){
+#if OS_STACK_WATERMARK
+		os_scanStackChunk();
+#endif
+		sleep_mode();
+	}
+#else
     while(1){
+#if OS_STACK_WATERMARK
+		os_scanStackChunk();
+#endif
 		lcd_writeChar('.');
 		delayMs(DEFAULT_OUTPUT_DELAY);
 	}
+#endif
+}
+
+/*!
+ *  Finds the highest range of the stack pool that is not used by the stack
+ *  of a process and can hold a stack of the given size. Ranges below a
+ *  stack that is in the way are tried until the pool is exhausted.
+ *  Must be called in a critical section.
+ *
+ *  \param size The size of the stack in bytes.
+ *  \return The bottom of the stack (its highest address) or 0 if there is no room.
+ */
+static uint16_t os_allocStack(uint16_t size) {
+	uint16_t bottom = BOTTOM_OF_PROCS_STACK;
+	while (bottom >= STACK_POOL_START && bottom - STACK_POOL_START + 1 >= size) {
+		uint16_t const limit = bottom - size + 1;
+		uint16_t below = bottom;
+		for (ProcessID pid = 0; pid < MAX_NUMBER_OF_PROCESSES; pid++) {
+			Process const* const process = &os_processes[pid];
+			if (process->state != OS_PS_UNUSED && process->stackLimit <= bottom
+			    && process->stackBottom >= limit && process->stackLimit <= below) {
+				below = process->stackLimit - 1;
+			}
+		}
+		if (below == bottom) {
+			return bottom;
+		}
+		bottom = below;
+	}
+	return 0;
+}
+
+/*!
+ *  Looks up the lowest slot that is not used according to the set of used
+ *  slots. If the state of that slot disagrees, because it was changed
+ *  directly, the slots are searched one by one instead.
+ *  Must be called in a critical section.
+ *
+ *  \return The ID of an unused slot or MAX_NUMBER_OF_PROCESSES if there is none.
+ */
+static ProcessID os_findFreeSlot(void) {
+	ProcessID pid = os_lowestProcess((ProcessSet)~os_usedSet);
+	if (pid < MAX_NUMBER_OF_PROCESSES && os_processes[pid].state == OS_PS_UNUSED) {
+		return pid;
+	}
+	for (pid = 0; pid < MAX_NUMBER_OF_PROCESSES; pid++) {
+		if (os_processes[pid].state == OS_PS_UNUSED) {
+			break;
+		}
+	}
+	return pid;
+}
+
+/*!
+ *  The initial frame of every process returns to this function when its
+ *  program returns. The process is killed, which frees its slot, its stack
+ *  and its memory and switches to the next process right away.
+ *  The idle process never returns and cannot be killed.
+ */
+static void os_exitProcess(void) {
+	os_kill(currentProc);
+	os_errorPStr(PSTR("Idle terminated"));
+	HALT;
 }
 
 /*!
  *  This function is used to execute a program that has been introduced with
  *  os_registerProgram.
- *  A stack will be provided if the process limit has not yet been reached.
+ *  A stack of STACK_SIZE_PROC bytes will be provided if the process limit has
+ *  not yet been reached and the stack pool has room for it.
  *  This function is multitasking safe. That means that programs can repost
  *  themselves, simulating TinyOS 2 scheduling (just kick off interrupts ;) ).
+ *  A program may simply return, its process is killed then.
+ *  Short jobs are cheaper as tasks, which share one process (see os_post).
  *
  *  \param program  The function of the program to start.
  *  \param priority A priority ranging 0..255 for the new process:
@@ -150,18 +674,35 @@ void idle(void) {
  *          defines.h on failure
  */
 ProcessID os_exec(Program *program, Priority priority) {
-	os_enterCriticalSection();
+	return os_execStack(program, priority, 0);
+}
+
+/*!
+ *  Like os_exec, but the stack of the new process is taken from the stack
+ *  pool with the requested size.
+ *
+ *  \param program  The function of the program to start.
+ *  \param priority The priority of the new process.
+ *  \param stackSize The size of the stack in bytes, 0 for STACK_SIZE_PROC.
+ *                   Sizes below STACK_SIZE_PROC_MIN are raised to it.
+ *  \return The index of the new process or INVALID_PROCESS if the process
+ *          limit is reached or the stack pool has no room.
+ */
+ProcessID os_execStack(Program *program, Priority priority, uint16_t stackSize) {
 	if (program == NULL) {
 		return INVALID_PROCESS;
 	}
-	ProcessID pid;
-	for (pid = 0; pid < MAX_NUMBER_OF_PROCESSES; pid++) {
-		if (os_processes[pid].state == OS_PS_UNUSED) {
-			break;
-		}
+	if (stackSize == 0) {
+		stackSize = STACK_SIZE_PROC;
+	} else if (stackSize < STACK_SIZE_PROC_MIN) {
+		stackSize = STACK_SIZE_PROC_MIN;
 	}
-	// If maximum reached
-	if (pid == MAX_NUMBER_OF_PROCESSES) {
+	os_enterCriticalSection();
+	ProcessID const pid = os_findFreeSlot();
+	uint16_t const stackBottom = os_allocStack(stackSize);
+	// If maximum reached or no room for the stack
+	if (pid == MAX_NUMBER_OF_PROCESSES || !stackBottom) {
+		os_leaveCriticalSection();
 		return INVALID_PROCESS;
 	}
 	
@@ -169,23 +710,221 @@ ProcessID os_exec(Program *program, Priority priority) {
 	os_processes[pid].program = program;
 	os_processes[pid].state = OS_PS_READY;
 	os_processes[pid].priority = priority;
-	os_processes[pid].sp.as_int = PROCESS_STACK_BOTTOM(pid);
-	os_processes[pid].checksum = 0; // Initialize checksum 
+	os_processes[pid].stackBottom = stackBottom;
+	os_processes[pid].stackLimit = stackBottom - stackSize + 1;
+	os_processes[pid].sp.as_int = stackBottom - sizeof(InitialFrame);
+	os_processes[pid].frame = OS_CF_FULL;
 	os_resetProcessSchedulingInformation(pid); // Set Age to 0 (Not bound to a scheduling strategy)
+#if OS_SCHEDULER_STATS
+	os_processRuntime[pid] = 0;
+	os_processSwitches[pid] = 0;
+#endif
+#if OS_STACK_WATERMARK
+	// Paint the whole stack, the initial context is written over it
+	for (uint8_t* p = (uint8_t*)os_processes[pid].stackLimit; p <= (uint8_t*)stackBottom; p++) {
+		*p = STACK_PAINT_PATTERN;
+	}
+	os_stackPeak[pid] = 0;
+	if (stackScanPid == pid) {
+		stackScanAddr = 0;
+	}
+#endif
 		
-	// Write low Byte on stack
-	*(os_processes[pid].sp.as_ptr--) = (uint8_t)((uint16_t)program & 0xFF);
+	// Write the initial context as one block
+	InitialFrame* const frame = (InitialFrame*)(os_processes[pid].sp.as_ptr + 1);
+	memset(frame->registers, 0, sizeof(frame->registers));
+	frame->programHigh = (uint8_t)((uint16_t)program >> 8);
+	frame->programLow = (uint8_t)((uint16_t)program & 0xFF);
+	frame->exitHigh = (uint8_t)((uint16_t)os_exitProcess >> 8);
+	frame->exitLow = (uint8_t)((uint16_t)os_exitProcess & 0xFF);
+#if STACK_CHECK_MODE == STACK_CHECK_CANARY
+	*(uint16_t*)os_processes[pid].stackLimit = STACK_CANARY;
+#endif
+	os_processes[pid].checksum = os_getStackChecksum(pid);
+	os_usedSet |= PROCESS_BIT(pid);
+	os_readySet |= PROCESS_BIT(pid);
+	os_trace(OS_TE_EXEC, pid);
+	if (pid != 0) {
+		os_restoreTick();
+	}
+	
+	os_leaveCriticalSection();
+	return pid;
+}
 
-	// Write high byte on stack
-	*(os_processes[pid].sp.as_ptr--) = (uint8_t)((uint16_t)program >> 8);
+/*!
+ *  Like os_exec, but the new process is periodic under OS_SS_EDF (see
+ *  os_setRealTimeParameters). The admission control runs before the process
+ *  gets the CPU, so a rejected process never runs and its slot is freed.
+ *
+ *  \param program  The function of the program to start.
+ *  \param priority The priority of the new process under the other strategies.
+ *  \param period   The time between two releases of a job in ms.
+ *  \param deadline The time a job has to finish after its release in ms, 0 for the period.
+ *  \param budget   The longest time a job may run in ms.
+ *  \return The index of the new process or INVALID_PROCESS if it could not
+ *          be started or was rejected by the admission control.
+ */
+ProcessID os_execRealTime(Program *program, Priority priority, Time period, Time deadline, Time budget) {
+	os_enterCriticalSection();
+	ProcessID pid = os_exec(program, priority);
+	if (pid != INVALID_PROCESS && !os_setRealTimeParameters(pid, period, deadline, budget)) {
+		os_kill(pid);
+		pid = INVALID_PROCESS;
+	}
+	os_leaveCriticalSection();
+	return pid;
+}
+
+/*!
+ *  Makes the process switch that the scheduler interrupt deferred because
+ *  preemption was disabled. Unlike os_yield, the time slice of the current
+ *  process is not dropped, as the tick already elapsed. With interrupts
+ *  disabled (e.g. in an ISR), the switch is left to the next tick.
+ *  This is called by os_enablePreemption.
+ */
+void os_reschedule(void) {
+	if (criticalSectionCount || !(SREG & (1 << SREG_I))) {
+		return;
+	}
+	os_switchVoluntarily();
+}
 
-	// Set SREG and 32 Regs on 0
-	for (int i = 0; i < 33; i++) {
-		*(os_processes[pid].sp.as_ptr--) = 0;
+/*!
+ *  Hands the processor over to the next process without waiting for the
+ *  scheduler tick. The caller gives up the remainder of its time slice and
+ *  the process that is selected next starts with a full tick.
+ *  Since this is a function call, only the registers the ABI obliges us to
+ *  preserve are saved. The state of the interrupt flag is kept.
+ *  Inside a critical section the scheduler is disabled, so nothing happens.
+ */
+void os_yield(void) {
+	if (criticalSectionCount) {
+		return;
+	}
+	os_dropTimeSlice();
+	os_switchVoluntarily();
+}
+
+/*!
+ *  Blocks the current process for (at least) the given time. Unlike delayMs,
+ *  the process leaves the ready set while it sleeps and is put into the
+ *  wakeup list, which is sorted by wakeup time and checked by the scheduler
+ *  on every tick. The idle process must not sleep.
+ *
+ *  \param ms The time to sleep in milliseconds (at most ~7 h). 0 merely yields.
+ */
+void os_sleep(Time ms) {
+	if (currentProc == 0) {
+		os_errorPStr(PSTR("Idle must not sleep"));
+		return;
+	}
+	if (ms == 0) {
+		os_yield();
+		return;
+	}
+	uint8_t const sreg = SREG;
+	cli();
+	Ticks const wakeup = os_ticks() + TIME_MS_TO_TICKS(ms);
+	wakeupTime[currentProc] = wakeup;
+	
+	// Insert behind all processes that are due earlier or at the same time
+	ProcessID* link = &wakeupHead;
+	while (*link != INVALID_PROCESS && TICKS_REACHED(wakeup, wakeupTime[*link])) {
+		link = &wakeupNext[*link];
+	}
+	wakeupNext[currentProc] = *link;
+	*link = currentProc;
+	
+	os_block();
+	SREG = sreg;
+}
+
+/*!
+ *  Blocks the current process. It leaves the ready set and the processor is
+ *  handed to the next process right away. The process continues when it is
+ *  passed to os_unblock.
+ *  To avoid losing a wakeup, callers should check their wait condition and
+ *  call this function with interrupts disabled. The idle process must never
+ *  block, and blocking inside a critical section is an error, as the
+ *  scheduler is disabled there.
+ */
+void os_block(void) {
+	if (currentProc == 0 || criticalSectionCount) {
+		os_errorPStr(PSTR("Invalid block"));
+		return;
+	}
+	uint8_t const sreg = SREG;
+	cli();
+	os_processes[currentProc].state = OS_PS_BLOCKED;
+	os_readySet &= ~PROCESS_BIT(currentProc);
+	os_trace(OS_TE_BLOCK, currentProc);
+	os_yield();
+	SREG = sreg;
+}
+
+/*!
+ *  Makes a blocked process ready again. Processes in any other state are
+ *  not affected. A sleeping process is taken out of the wakeup list, so it
+ *  can sleep again right away. This may be called from interrupt service
+ *  routines.
+ *
+ *  \param pid The process to unblock.
+ */
+void os_unblock(ProcessID pid) {
+	uint8_t const sreg = SREG;
+	cli();
+	if (pid < MAX_NUMBER_OF_PROCESSES && os_processes[pid].state == OS_PS_BLOCKED) {
+		os_cancelWakeup(pid);
+		os_processes[pid].state = OS_PS_READY;
+		os_readySet |= PROCESS_BIT(pid);
+		os_trace(OS_TE_WAKE, pid);
+		os_restoreTick();
+	}
+	SREG = sreg;
+}
+
+/*!
+ *  Terminates a process. The slot of the process is freed and it is removed
+ *  from the ready set, so it will not be scheduled again. Its memory on all
+ *  heaps is freed as well, and the mutexes it holds are passed on. The idle
+ *  process cannot be killed.
+ *  If a process kills itself, this function does not return.
+ *
+ *  \param pid The ID of the process to be killed.
+ *  \return True if the process was killed, false if there was nothing to kill.
+ */
+bool os_kill(ProcessID pid) {
+	if (pid == 0 || pid >= MAX_NUMBER_OF_PROCESSES) {
+		return false;
+	}
+	os_enterCriticalSection();
+	if (os_processes[pid].state == OS_PS_UNUSED) {
+		os_leaveCriticalSection();
+		return false;
+	}
+	uint8_t const sreg = SREG;
+	cli();
+	os_processes[pid].state = OS_PS_UNUSED;
+	os_usedSet &= ~PROCESS_BIT(pid);
+	os_readySet &= ~PROCESS_BIT(pid);
+	os_cancelWakeup(pid);
+	SREG = sreg;
+	
+	os_freeProcessPools(pid);
+	os_freeProcessSync(pid);
+	for (uint8_t heap = 0; heap < os_getHeapListLength(); heap++) {
+		os_freeProcessMemory(os_lookupHeap(heap), pid);
 	}
 	
+	if (pid == currentProc) {
+		// The critical sections of a dead process are void
+		criticalSectionCount = 1;
+		os_leaveCriticalSection();
+		os_yield(); // Never returns, the process is not selected again
+	}
 	os_leaveCriticalSection();
-	return pid;
+	return true;
 }
 
 /*!
@@ -208,14 +947,21 @@ void os_initScheduler(void) {
 	for (uint8_t i = 0; i < MAX_NUMBER_OF_PROCESSES; i++) {
 		os_processes[i].state = OS_PS_UNUSED;
 	}
-	if(autostart_head->program == idle){
-		autostart_head = autostart_head->next;
-	}
-    while(autostart_head != NULL){
-		os_exec(autostart_head->program, DEFAULT_PRIORITY);
-		autostart_head = autostart_head->next;
-	}
+	os_usedSet = 0;
+	os_readySet = 0;
+#if OS_SCHEDULER_STATS
+	os_resetSchedulerStats();
+#endif
+	// The idle process always has ID 0
 	os_exec(idle, DEFAULT_PRIORITY);
+	for (struct program_linked_list_node *node = autostart_head; node != NULL; node = node->next) {
+		if (node->program != idle) {
+			os_execStack(node->program, DEFAULT_PRIORITY, node->stackSize);
+		}
+	}
+#if OS_TASKMAN_PROCESS
+	os_startTaskMan();
+#endif
 }
 
 /*!
@@ -237,15 +983,62 @@ ProcessID os_getCurrentProc(void) {
 	return currentProc;
 }
 
+/*!
+ *  A simple getter for the set of processes that are ready or running.
+ *
+ *  \return The ready set, bit i is set iff process i may be scheduled.
+ */
+ProcessSet os_getReadySet(void) {
+	return os_readySet;
+}
+
 /*!
  *  Sets the current scheduling strategy.
  *
  *  \param strategy The strategy that will be used after the function finishes.
  */
 void os_setSchedulingStrategy(SchedulingStrategy strategy) {
-	os_resetSchedulingInformation(strategy); 
+#ifdef OS_FIXED_SCHEDULING_STRATEGY
+	// Only the strategy the system was built with exists
+	if (strategy != OS_FIXED_SCHEDULING_STRATEGY) {
+		return;
+	}
+#else
+	if (strategy >= OS_SS_COUNT) {
+		return;
+	}
+#endif
+	uint8_t const sreg = SREG;
+	cli();
+	actual = strategy;
+	os_resetSchedulingInformation(strategy);
+	SREG = sreg;
 }
 
+#ifndef OS_FIXED_SCHEDULING_STRATEGY
+
+/*!
+ *  Plugs a new implementation into the strategy table. This can be used to
+ *  replace one of the built-in strategies by an application specific one.
+ *  If the strategy is active, it is used from the next tick on.
+ *
+ *  \param strategy The strategy to replace.
+ *  \param function The implementation that will be called on every tick.
+ *  \return True iff the implementation was registered.
+ */
+bool os_registerSchedulingStrategy(SchedulingStrategy strategy, SchedulingStrategyFunction* function) {
+	if (strategy >= OS_SS_COUNT || !function) {
+		return false;
+	}
+	uint8_t const sreg = SREG;
+	cli();
+	strategyTable[strategy] = function;
+	SREG = sreg;
+	return true;
+}
+
+#endif
+
 /*!
  *  This is a getter for retrieving the current scheduling strategy.
  *
@@ -256,58 +1049,181 @@ SchedulingStrategy os_getSchedulingStrategy(void) {
 }
 
 /*!
- *  Enters a critical code section by disabling the scheduler if needed.
- *  This function stores the nesting depth of critical sections of the current
- *  process (e.g. if a function with a critical section is called from another
+ *  Changes the regular length of a scheduler tick at runtime. Short ticks
+ *  make the system more responsive, long ticks reduce the time spent in
+ *  context switches. Periods below MIN_TICK_PERIOD are raised to it, so the
+ *  scheduler always gets to finish before the next tick is due. A tick that
+ *  is currently stretched while idling keeps its length.
+ *
+ *  \param period The length of a tick in timer 2 counts (1024 CPU cycles each).
+ */
+void os_setTickPeriod(uint8_t period) {
+	if (period < MIN_TICK_PERIOD) {
+		period = MIN_TICK_PERIOD;
+	}
+	uint8_t const sreg = SREG;
+	cli();
+	tickPeriod = period;
+	if (os_readySet != 1 || !OS_TICKLESS_IDLE) {
+		OCR2A = period;
+		// The counter may already be past the new compare value
+		if (TCNT2 >= period) {
+			TCNT2 = 0;
+		}
+	}
+	SREG = sreg;
+}
+
+/*!
+ *  Returns the regular length of a scheduler tick.
+ *
+ *  \return The tick period in timer 2 counts.
+ */
+uint8_t os_getTickPeriod(void) {
+	return tickPeriod;
+}
+
+/*!
+ *  Enters a critical code section by disabling preemption. This function
+ *  stores the nesting depth of critical sections of the current process
+ *  (e.g. if a function with a critical section is called from another
  *  critical section) to ensure correct behavior when leaving the section.
- *  This function supports up to 255 nested critical sections.
+ *  Interrupts stay enabled, the scheduler interrupt only defers the switch.
+ *  This function supports up to 255 nested critical sections. Unlike
+ *  os_disablePreemption, an overflow is reported and the section is traced.
  */
 void os_enterCriticalSection(void) {
-    uint8_t GIEB = SREG>>7; // 1
-	
-	SREG &= 0b01111111; // 2
 	if(criticalSectionCount == 255){
 		os_errorPStr(PSTR("Critical section overflow"));
 	}
-	criticalSectionCount++; // 3
-	TIMSK2 &= ~(1 << OCIE2A); // 4
-	
-	SREG |= GIEB<<7; // 5
+	os_disablePreemption();
+	os_trace(OS_TE_ENTER_CS, currentProc);
 }
 
 /*!
- *  Leaves a critical code section by enabling the scheduler if needed.
- *  This function utilizes the nesting depth of critical sections
- *  stored by os_enterCriticalSection to check if the scheduler
- *  has to be reactivated.
+ *  Leaves a critical code section. When the outermost section is left and
+ *  the scheduler deferred a switch in the meantime, the switch is made right
+ *  away (see os_enablePreemption). Unlike os_enablePreemption, leaving more
+ *  sections than were entered is reported and the section is traced.
  */
 void os_leaveCriticalSection(void) {
-    uint8_t GIEB = SREG>>7; // 1
-    SREG &= 0b01111111; // 2
-
-    //If criticalSectionCount < 0 -> Error:	
 	if(criticalSectionCount == 0){
 		os_errorPStr(PSTR("Critical Sections don't match"));
 	}
-    criticalSectionCount--; // 3 
-	
-    if(criticalSectionCount == 0){
-		TIMSK2 |= 1 << OCIE2A; // 4
-	}
-	
-    SREG |= GIEB<<7; // 5
+	os_trace(OS_TE_LEAVE_CS, currentProc);
+	os_enablePreemption();
 }
 
 /*!
  *  Calculates the checksum of the stack for a certain process.
+ *  Which bytes are covered depends on STACK_CHECK_MODE: the occupied part
+ *  from the saved stack pointer to the bottom (STACK_CHECK_LIVE), the whole
+ *  memory chunk (STACK_CHECK_FULL) or none at all (STACK_CHECK_CANARY, the
+ *  guard word is compared by the scheduler instead).
  *
  *  \param pid The ID of the process for which the stack's checksum has to be calculated.
  *  \return The checksum of the pid'th stack.
  */
 StackChecksum os_getStackChecksum(ProcessID pid) {
     uint8_t checksum = 0;
-	for (uint8_t p = 0; p <= STACK_SIZE_PROC; p++) {
-	    checksum ^= *(PROCESS_STACK_BOTTOM(pid)+p);
+#if STACK_CHECK_MODE == STACK_CHECK_LIVE
+	uint8_t const* const bottom = (uint8_t const*)os_processes[pid].stackBottom;
+	for (uint8_t const* p = os_processes[pid].sp.as_ptr + 1; p <= bottom; p++) {
+	    checksum ^= *p;
+	}
+#elif STACK_CHECK_MODE == STACK_CHECK_FULL
+	uint8_t const* const bottom = (uint8_t const*)os_processes[pid].stackBottom;
+	for (uint8_t const* p = (uint8_t const*)os_processes[pid].stackLimit; p <= bottom; p++) {
+	    checksum ^= *p;
     }
+#endif
 	return checksum;
 }
+
+/*!
+ *  Verifies the integrity of a process stack before the process is restored.
+ *  A saved stack pointer beyond the limit of its chunk is always reported as an
+ *  overflow. Depending on STACK_CHECK_MODE, the guard word at the limit or the
+ *  checksum that was taken when the process was suspended is compared as well.
+ *  Errors are reported with os_errorPStr.
+ *
+ *  \param pid The ID of the process whose stack is checked.
+ */
+static void os_checkStack(ProcessID pid) {
+	if (os_processes[pid].sp.as_int + 1 < os_processes[pid].stackLimit) {
+		os_errorPStr(PSTR("Stack overflow"));
+	}
+#if STACK_CHECK_MODE == STACK_CHECK_CANARY
+	if (*(uint16_t const*)os_processes[pid].stackLimit != STACK_CANARY) {
+		os_errorPStr(PSTR("Stack overflow"));
+	}
+#else
+	if (os_processes[pid].checksum != os_getStackChecksum(pid)) {
+		os_errorPStr(PSTR("Checksum incorrect"));
+	}
+#endif
+}
+
+#if OS_STACK_WATERMARK
+
+/*!
+ *  Scans up to STACK_SCAN_CHUNK bytes of the stack of one process, starting
+ *  at its limit and moving towards its bottom. The first byte that does not
+ *  hold STACK_PAINT_PATTERN any more is the deepest one the process has used
+ *  so far. Once it is found, or the scan reaches the known peak, the next
+ *  process is scanned. Peaks can only grow, so the scan of a process that
+ *  used more stack in the meantime is simply caught up with in the next
+ *  round. The scan is done in a critical section such that the process
+ *  cannot be killed in the middle of a chunk.
+ */
+static void os_scanStackChunk(void) {
+	os_enterCriticalSection();
+	Process const* const process = &os_processes[stackScanPid];
+	bool done = true;
+	if (process->state != OS_PS_UNUSED) {
+		uint8_t const* const peak = (uint8_t const*)(process->stackBottom - os_stackPeak[stackScanPid] + 1);
+		if (!stackScanAddr) {
+			stackScanAddr = process->stackLimit;
+#if STACK_CHECK_MODE == STACK_CHECK_CANARY
+			// The guard word is not part of the painted area
+			stackScanAddr += sizeof(uint16_t);
+#endif
+		}
+		uint8_t const* p = (uint8_t const*)stackScanAddr;
+		uint8_t const* end = p + STACK_SCAN_CHUNK;
+		if (end > peak) {
+			end = peak;
+		}
+		while (p < end && *p == STACK_PAINT_PATTERN) {
+			p++;
+		}
+		if (p < end) {
+			os_stackPeak[stackScanPid] = process->stackBottom - (uint16_t)p + 1;
+		} else if (p < peak) {
+			stackScanAddr = (uint16_t)p;
+			done = false;
+		}
+	}
+	if (done) {
+		stackScanAddr = 0;
+		stackScanPid = (stackScanPid + 1) % MAX_NUMBER_OF_PROCESSES;
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Returns the deepest stack usage of a process that the idle process has
+ *  found so far. Until the stack of a process was scanned once, this is 0.
+ *
+ *  \param pid The process to look up.
+ *  \return The peak usage in bytes, counted from the bottom of the stack.
+ */
+uint16_t os_getStackPeak(ProcessID pid) {
+	uint8_t const sreg = SREG;
+	cli();
+	uint16_t const peak = os_stackPeak[pid];
+	SREG = sreg;
+	return peak;
+}
+
+#endif
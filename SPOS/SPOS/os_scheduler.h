@@ -12,9 +12,11 @@
 #define _OS_SCHEDULER_H
 
 #include <stdbool.h>
+#include <avr/interrupt.h>
 
 #include "defines.h"
 #include "os_process.h"
+#include "util.h"
 
 //----------------------------------------------------------------------------
 // Types
@@ -26,9 +28,40 @@ typedef enum SchedulingStrategy {
     OS_SS_RANDOM,
     OS_SS_RUN_TO_COMPLETION,
     OS_SS_ROUND_ROBIN,
-    OS_SS_INACTIVE_AGING
+    OS_SS_INACTIVE_AGING,
+    OS_SS_EDF,               //!< Earliest deadline first for periodic processes
+    OS_SS_COUNT              //!< Number of strategies, not a strategy itself
 } SchedulingStrategy;
 
+//! Signature of a scheduling strategy, returns the process that runs next
+typedef ProcessID SchedulingStrategyFunction(Process const processes[], ProcessID current);
+
+#if OS_SCHEDULER_STATS
+
+//! The phases of a process switch that are timed separately
+typedef enum StatsPhase {
+    OS_STAT_CHECKSUM,    //!< Checksum of the stack of the outgoing process
+    OS_STAT_INPUT,       //!< Poll of the task manager button chord
+    OS_STAT_SELECT,      //!< Wakeups and the scheduling strategy
+    OS_STAT_STACK,       //!< Tick setup and stack check of the incoming process
+    OS_STAT_PHASE_COUNT
+} StatsPhase;
+
+/*!
+ *  Timing of all process switches since the last reset. Every duration is
+ *  given in timer 0 counts (TC0_PRESCALER CPU cycles) and covers the time
+ *  between saving and restoring a context.
+ */
+typedef struct {
+    uint16_t minLatency;                  //!< Shortest process switch
+    uint16_t maxLatency;                  //!< Longest process switch
+    uint32_t sumLatency;                  //!< Sum of all process switches
+    uint32_t switches;                    //!< Number of process switches that were timed
+    uint32_t phase[OS_STAT_PHASE_COUNT];  //!< Time spent in each phase
+} SchedulerStats;
+
+#endif
+
 //----------------------------------------------------------------------------
 // Function headers
 //----------------------------------------------------------------------------
@@ -42,6 +75,27 @@ void os_startScheduler(void);
 //! Executes a process by instantiating a program
 ProcessID os_exec(Program program, Priority priority);
 
+//! Executes a process with a stack of the given size
+ProcessID os_execStack(Program program, Priority priority, uint16_t stackSize);
+
+//! Executes a periodic process if the admission control of OS_SS_EDF accepts it
+ProcessID os_execRealTime(Program program, Priority priority, Time period, Time deadline, Time budget);
+
+//! Voluntarily hands the processor over to the next process
+void os_yield(void);
+
+//! Blocks the current process for some milliseconds
+void os_sleep(Time ms);
+
+//! Blocks the current process until it is unblocked
+void os_block(void);
+
+//! Makes a blocked process ready again
+void os_unblock(ProcessID pid);
+
+//! Terminates a process and frees its slot
+bool os_kill(ProcessID pid);
+
 //! Returns the number of programs
 uint8_t os_getNumberOfRegisteredPrograms(void);
 
@@ -57,17 +111,119 @@ void os_setSchedulingStrategy(SchedulingStrategy strategy);
 //! Gets the current scheduling strategy
 SchedulingStrategy os_getSchedulingStrategy(void);
 
+#ifndef OS_FIXED_SCHEDULING_STRATEGY
+//! Replaces the implementation of a scheduling strategy
+bool os_registerSchedulingStrategy(SchedulingStrategy strategy, SchedulingStrategyFunction* function);
+#endif
+
+//! Sets the regular length of a scheduler tick in timer 2 counts
+void os_setTickPeriod(uint8_t period);
+
+//! Returns the regular length of a scheduler tick in timer 2 counts
+uint8_t os_getTickPeriod(void);
+
+//! Returns the set of processes that may be selected to run
+ProcessSet os_getReadySet(void);
+
+#if OS_SCHEDULER_STATS
+
+//! Returns the timing of the process switches
+SchedulerStats const* os_getSchedulerStats(void);
+
+//! Returns the CPU time a process got in timer 0 counts
+Time os_getProcessRuntime(ProcessID pid);
+
+//! Returns how often a process was switched to
+uint16_t os_getProcessSwitches(ProcessID pid);
+
+//! Clears the timing and CPU accounting of all processes
+void os_resetSchedulerStats(void);
+
+#endif
+
 //! Calculates the checksum of the stack for the corresponding process of pid.
 StackChecksum os_getStackChecksum(ProcessID pid);
 
+#if OS_STACK_WATERMARK
+//! Returns the peak stack usage of a process in bytes
+uint16_t os_getStackPeak(ProcessID pid);
+#endif
+
 //----------------------------------------------------------------------------
 // Critical section management
 //----------------------------------------------------------------------------
 
+/*
+ * There are two kinds of sections. Critical sections only disable preemption:
+ * interrupts keep being served, but the scheduler does not switch to another
+ * process. This is what protects data that is shared between processes.
+ * Data that is shared with an ISR needs interrupts disabled, which should
+ * only be done for a few instructions with os_disableInterrupts.
+ */
+
+//! Count of currently nested critical sections
+extern uint8_t criticalSectionCount;
+
+//! Whether the scheduler deferred a process switch because preemption was disabled
+extern volatile bool os_reschedulePending;
+
+//! The saved interrupt state of os_disableInterrupts
+typedef uint8_t InterruptState;
+
 //! Enters a critical code section
 void os_enterCriticalSection(void);
 
 //! Leaves a critical code section
 void os_leaveCriticalSection(void);
 
+//! Makes the process switch that was deferred while preemption was disabled
+void os_reschedule(void);
+
+/*!
+ *  Disables preemption like os_enterCriticalSection, but without the
+ *  overflow check and the trace, so it is expanded inline.
+ */
+static inline void os_disablePreemption(void) {
+	criticalSectionCount++;
+	__asm__ volatile("" ::: "memory");
+}
+
+/*!
+ *  Enables preemption again like os_leaveCriticalSection, but without the
+ *  check for unbalanced calls. When the outermost section is left and the
+ *  scheduler deferred a switch in the meantime, it is made right away.
+ */
+static inline void os_enablePreemption(void) {
+	__asm__ volatile("" ::: "memory");
+	if (!--criticalSectionCount && os_reschedulePending) {
+		os_reschedule();
+	}
+}
+
+//! Returns whether the scheduler may switch to another process
+static inline bool os_isPreemptible(void) {
+	return !criticalSectionCount;
+}
+
+/*!
+ *  Disables interrupts for a short section that accesses data shared with
+ *  an ISR. Sections may be nested, each restores the state it found.
+ *
+ *    InterruptState const state = os_disableInterrupts();
+ *    ...
+ *    os_restoreInterrupts(state);
+ *
+ *  \return The interrupt state to pass to os_restoreInterrupts.
+ */
+static inline InterruptState os_disableInterrupts(void) {
+	InterruptState const state = SREG;
+	cli();
+	return state;
+}
+
+//! Ends a section that was started with os_disableInterrupts
+static inline void os_restoreInterrupts(InterruptState state) {
+	SREG = state;
+}
+
 #endif
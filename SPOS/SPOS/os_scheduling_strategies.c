@@ -3,38 +3,179 @@
 Scheduling strategies used by the Interrupt Service RoutineA from Timer 2 (in scheduler.c)
 to determine which process may continue its execution next.
 
-The file contains five strategies:
+The file contains six strategies:
 -even
 -random
 -round-robin
 -inactive-aging
 -run-to-completion
+-earliest-deadline-first
 */
 
 #include "os_scheduling_strategies.h"
 #include "defines.h"
+#include "util.h"
 
 #include <stdlib.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 SchedulingInformation schedulingInfo;
 
+//----------------------------------------------------------------------------
+// Process set primitives
+//----------------------------------------------------------------------------
+
+//! Number of set bits in a nibble
+static uint8_t const PROGMEM nibbleCount[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+//! Index of the lowest set bit in a nibble (0 for the empty nibble)
+static uint8_t const PROGMEM nibbleLowest[16] = {0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0};
+
+//! Index of the highest set bit in a nibble (0 for the empty nibble)
+static uint8_t const PROGMEM nibbleHighest[16] = {0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3};
+
+/*!
+ *  Counts the members of a process set with two table lookups per byte.
+ *
+ *  \param set The set to count.
+ *  \return The number of processes in the set.
+ */
+uint8_t os_countProcesses(ProcessSet set) {
+	uint8_t count = 0;
+	for(; set; set >>= 8){
+		count += pgm_read_byte(&nibbleCount[set & 0xF]) + pgm_read_byte(&nibbleCount[(set >> 4) & 0xF]);
+	}
+	return count;
+}
+
+/*!
+ *  Finds the member of a process set with the lowest ID.
+ *
+ *  \param set The set to search.
+ *  \return The lowest ID in the set or INVALID_PROCESS if the set is empty.
+ */
+ProcessID os_lowestProcess(ProcessSet set) {
+	if(!set){
+		return INVALID_PROCESS;
+	}
+	ProcessID base = 0;
+	while(!(set & 0xF)){
+		set >>= 4;
+		base += 4;
+	}
+	return base + pgm_read_byte(&nibbleLowest[set & 0xF]);
+}
+
+/*!
+ *  Finds the member of a process set with the highest ID.
+ *
+ *  \param set The set to search.
+ *  \return The highest ID in the set or INVALID_PROCESS if the set is empty.
+ */
+ProcessID os_highestProcess(ProcessSet set) {
+	if(!set){
+		return INVALID_PROCESS;
+	}
+	ProcessID base = 0;
+	while(set >> 4){
+		set >>= 4;
+		base += 4;
+	}
+	return base + pgm_read_byte(&nibbleHighest[set]);
+}
+
+/*!
+ *  Finds the next member of a process set after current, wrapping around at
+ *  the highest ID. The idle process is never returned unless it is the only
+ *  choice, so current itself is returned if it is the only other member.
+ *
+ *  \param set The set to search.
+ *  \param current The process to start searching after.
+ *  \return The next process in the set, or 0 if the set holds no process but idle.
+ */
+ProcessID os_nextProcess(ProcessSet set, ProcessID current) {
+	set &= ~1; // Exclude idle
+	// Wraps around at the highest ID, as the bit above it is shifted out
+	ProcessSet const upToCurrent = (ProcessSet)(PROCESS_BIT(current) << 1) - 1;
+	ProcessSet const after = set & ~upToCurrent;
+	if(after){
+		return os_lowestProcess(after);
+	}
+	if(set){
+		return os_lowestProcess(set);
+	}
+	return 0;
+}
+
+//----------------------------------------------------------------------------
+// Strategies
+//----------------------------------------------------------------------------
+
+//! Wrap-safe check whether the EDF time now has reached time (at most 2^15 units apart)
+#define EDF_REACHED(now, time) ((int16_t)((uint16_t)(now) - (uint16_t)(time)) >= 0)
+
+/*!
+ *  Returns the clock of OS_SS_EDF, which counts timer 0 overflows and
+ *  wraps around after ~215 s.
+ *
+ *  \return The current time in EDF_TICK_COUNTS units.
+ */
+static uint16_t os_edfNow(void) {
+	return (uint16_t)(os_ticks() / EDF_TICK_COUNTS);
+}
+
+/*!
+ *  Converts milliseconds to the time unit of OS_SS_EDF.
+ *
+ *  \param ms The time to convert.
+ *  \param roundUp Whether to round up (budgets) instead of down (periods).
+ *  \return The time in EDF_TICK_COUNTS units, 0 if it exceeds EDF_MAX_TICKS.
+ */
+static uint16_t os_edfFromMs(Time ms, bool roundUp) {
+	Ticks const counts = TIME_MS_TO_TICKS(ms) + (roundUp ? EDF_TICK_COUNTS - 1 : 0);
+	Ticks const units = counts / EDF_TICK_COUNTS;
+	return units > EDF_MAX_TICKS ? 0 : units;
+}
+
+/*!
+ *  Returns the length of the time slice a process gets under RoundRobin.
+ *  Processes without an explicit quantum fall back to their priority.
+ *
+ *  \param id The process to look up.
+ *  \return The number of ticks the process may keep the CPU.
+ */
+static uint8_t os_effectiveQuantum(ProcessID id) {
+	uint8_t const quantum = schedulingInfo.quantum[id];
+	return quantum ? quantum : os_getProcessSlot(id)->priority;
+}
+
 /*!
  *  Reset the scheduling information for a specific strategy
- *  This is only relevant for RoundRobin and InactiveAging
+ *  This is only relevant for RoundRobin, InactiveAging and EDF
  *  and is done when the strategy is changed through os_setSchedulingStrategy
  *
  *  \param strategy  The strategy to reset information for
  */
 void os_resetSchedulingInformation(SchedulingStrategy strategy) {
-    if(strategy == OS_SS_ROUND_ROBIN){
-		schedulingInfo.timeSlice = os_getCurrentProc()->priority; // Don't know how to access priority of currentProc
+	if(strategy == OS_SS_ROUND_ROBIN){
+		schedulingInfo.timeSlice = os_effectiveQuantum(os_getCurrentProc());
 	}
 	if(strategy == OS_SS_INACTIVE_AGING){
-		uint8_t iterator = 0;
-		while(schedulingInfo.age[iterator] != 0){
+		for(uint8_t iterator = 0; iterator < MAX_NUMBER_OF_PROCESSES; iterator++){
 			schedulingInfo.age[iterator] = 0;
 		}
 	}
+	if(strategy == OS_SS_EDF){
+		// The time before the switch is not charged to any job, and the releases start anew
+		Ticks const ticks = os_ticks();
+		schedulingInfo.edfLast = ticks;
+		for(ProcessSet members = schedulingInfo.edfSet; members; members &= members - 1){
+			EdfInformation* const job = &schedulingInfo.edf[os_lowestProcess(members)];
+			job->release = ticks / EDF_TICK_COUNTS;
+			job->remaining = 0;
+		}
+	}
 }
 
 /*!
@@ -46,6 +187,142 @@ void os_resetSchedulingInformation(SchedulingStrategy strategy) {
  */
 void os_resetProcessSchedulingInformation(ProcessID id) {
     schedulingInfo.age[id] = 0;
+    schedulingInfo.quantum[id] = 0;
+    schedulingInfo.edf[id] = (EdfInformation){0};
+    schedulingInfo.edfSet &= ~PROCESS_BIT(id);
+}
+
+/*!
+ *  Configures how many ticks a process may run in a row under RoundRobin.
+ *  CPU-bound processes can be given long quanta to save context switches,
+ *  latency-sensitive ones short quanta. The new quantum applies from the
+ *  next time slice of the process on.
+ *
+ *  \param id The process to configure.
+ *  \param quantum The length of its time slice in ticks, 0 to use its priority.
+ */
+void os_setProcessQuantum(ProcessID id, uint8_t quantum) {
+	if(id >= MAX_NUMBER_OF_PROCESSES){
+		return;
+	}
+	schedulingInfo.quantum[id] = quantum;
+}
+
+/*!
+ *  Returns the quantum configured with os_setProcessQuantum.
+ *
+ *  \param id The process to look up.
+ *  \return The quantum in ticks, 0 if the priority of the process is used.
+ */
+uint8_t os_getProcessQuantum(ProcessID id) {
+	if(id >= MAX_NUMBER_OF_PROCESSES){
+		return 0;
+	}
+	return schedulingInfo.quantum[id];
+}
+
+/*!
+ *  Makes a process periodic under OS_SS_EDF. Every period, a job of the
+ *  process is released that has to finish within the deadline and may use
+ *  the CPU for at most its budget (its worst case execution time). A job
+ *  that used up its budget does not run again before the next release, so
+ *  an overrun cannot make other processes miss their deadlines. As the
+ *  budget is checked on every tick, a job may exceed it by up to one tick.
+ *  The parameters are only accepted if the density (budget by deadline) of
+ *  all periodic processes stays within OS_EDF_UTILIZATION percent, which
+ *  guarantees that EDF meets all deadlines. Times are rounded to the time
+ *  unit of EDF (EDF_TICK_COUNTS), budgets up and the others down.
+ *
+ *  \param id The process to configure.
+ *  \param period The time between two releases in ms, 0 to make it a regular process again.
+ *  \param deadline The time a job has to finish after its release in ms, 0 for the period.
+ *  \param budget The longest time a job may run in ms.
+ *  \return False if the parameters are invalid or rejected by the admission control.
+ */
+bool os_setRealTimeParameters(ProcessID id, Time period, Time deadline, Time budget) {
+	if(id == 0 || id >= MAX_NUMBER_OF_PROCESSES){
+		return false;
+	}
+	if(period == 0){
+		uint8_t const sreg = SREG;
+		cli();
+		schedulingInfo.edfSet &= ~PROCESS_BIT(id);
+		SREG = sreg;
+		return true;
+	}
+	EdfInformation job = {
+		.period = os_edfFromMs(period, false),
+		.deadline = os_edfFromMs(deadline ? deadline : period, false),
+		.budget = os_edfFromMs(budget, true)
+	};
+	if(!job.period || !job.deadline || !job.budget || job.deadline > job.period || job.budget > job.deadline){
+		return false;
+	}
+
+	uint8_t const sreg = SREG;
+	cli();
+	// Densities in 16 bit fixed point, with deadline <= period this is sufficient for EDF
+	uint32_t density = ((uint32_t)job.budget << 16) / job.deadline;
+	for(ProcessSet members = schedulingInfo.edfSet & ~PROCESS_BIT(id); members; members &= members - 1){
+		ProcessID const other = os_lowestProcess(members);
+		if(os_getProcessSlot(other)->state != OS_PS_UNUSED){
+			density += ((uint32_t)schedulingInfo.edf[other].budget << 16) / schedulingInfo.edf[other].deadline;
+		}
+	}
+	bool const admitted = density <= (((uint32_t)OS_EDF_UTILIZATION << 16) / 100);
+	if(admitted){
+		job.release = os_edfNow(); // The first job is released right away
+		schedulingInfo.edf[id] = job;
+		schedulingInfo.edfSet |= PROCESS_BIT(id);
+	}
+	SREG = sreg;
+	return admitted;
+}
+
+/*!
+ *  Returns how many jobs of a periodic process used up their budget or
+ *  were not done by their deadline.
+ *
+ *  \param id The process to look up.
+ *  \return The number of missed jobs, it saturates at 255.
+ */
+uint8_t os_getDeadlineMisses(ProcessID id) {
+	if(id >= MAX_NUMBER_OF_PROCESSES){
+		return 0;
+	}
+	return schedulingInfo.edf[id].misses;
+}
+
+/*!
+ *  Has to be called by a periodic process when its job is done. The process
+ *  sleeps until the next job is released. Other processes merely yield.
+ */
+void os_waitForNextPeriod(void) {
+	ProcessID const id = os_getCurrentProc();
+	if(!(schedulingInfo.edfSet & PROCESS_BIT(id))){
+		os_yield();
+		return;
+	}
+	uint8_t const sreg = SREG;
+	cli();
+	schedulingInfo.edf[id].remaining = 0;
+	int16_t const wait = schedulingInfo.edf[id].release - os_edfNow();
+	SREG = sreg;
+	// Waking up early is fine, a process without budget is not selected
+	if(wait > 0){
+		os_sleep(TIME_TICKS_TO_MS((Ticks)wait * EDF_TICK_COUNTS));
+	} else {
+		os_yield();
+	}
+}
+
+/*!
+ *  Discards what is left of the time slice of the current process. This is
+ *  used when a process yields, so that strategies which keep a process for
+ *  several ticks (i.e. RoundRobin) move on to the next one.
+ */
+void os_dropTimeSlice(void) {
+	schedulingInfo.timeSlice = 0;
 }
 
 /*!
@@ -59,25 +336,7 @@ void os_resetProcessSchedulingInformation(ProcessID id) {
  *  \return The next process to be executed determined on the basis of the even strategy.
  */
 ProcessID os_Scheduler_Even(Process const processes[], ProcessID current) {
-	uint8_t numberOfReadyProcs = 0;
-	for(uint8_t i = 0;i < MAX_NUMBER_OF_PROCESSES;i++){
-		if(processes[i].state == OS_PS_READY){
-			numberOfReadyProcs++;
-		}
-	}
-	if(numberOfReadyProcs == 1){ //When only the idle process is available return pid 0
-		return 0;
-	}
-	while(1){ //Find next ready process
-		if(current == 7){ //Cycle through pids
-			current = 1;
-			}else{
-			current++;
-		}
-		if(processes[current].state == OS_PS_READY){
-			return current;
-		}
-	}
+	return os_nextProcess(os_getReadySet(), current);
 }
 
 /*!
@@ -89,31 +348,29 @@ ProcessID os_Scheduler_Even(Process const processes[], ProcessID current) {
  *  \return The next process to be executed determined on the basis of the random strategy.
  */
 ProcessID os_Scheduler_Random(Process const processes[], ProcessID current) {
-    uint8_t numberOfReadyProcs = 0;
-	for(uint8_t i = 0;i < MAX_NUMBER_OF_PROCESSES;i++){
-		if(processes[i].state == OS_PS_READY){
-			numberOfReadyProcs++;
-		}
-	}
-	if(numberOfReadyProcs == 1){
+	ProcessSet set = os_getReadySet() & ~1; // Exclude idle
+	uint8_t const numberOfReadyProcs = os_countProcesses(set);
+	if(numberOfReadyProcs == 0){
 		return 0;
 	}
-	uint8_t array[numberOfReadyProcs];
-	numberOfReadyProcs = 0;
-	for(uint8_t i = 0;i < MAX_NUMBER_OF_PROCESSES;i++){
-		if(processes[i].state == OS_PS_READY){
-			array[numberOfReadyProcs] = i;
-			numberOfReadyProcs++;
-		}
+	uint8_t skip = rand() % numberOfReadyProcs;
+	// Skip whole nibbles that lie below the chosen process
+	ProcessID base = 0;
+	for(uint8_t lowCount; skip >= (lowCount = os_countProcesses(set & 0xF)); base += 4){
+		skip -= lowCount;
+		set >>= 4;
+	}
+	while(skip--){
+		set &= set - 1; // Drop the lowest member
 	}
-	return array[(rand()%(numberOfReadyProcs-1))+1]; // Random Idea to exclude 0 (the first idle entry) by reducing numberOfReadyProcs and incrementing the solution 
+	return base + os_lowestProcess(set);
 }
 
 /*!
  *  This function implements the round-robin strategy. In this strategy, process priorities
  *  are considered when choosing the next process. A process stays active as long its time slice
- *  does not reach zero. This time slice is initialized with the priority of each specific process
- *  and decremented each time this function is called. If the time slice reaches zero, the even
+ *  does not reach zero. This time slice is initialized with the quantum of each specific process
+ *  (its priority unless set with os_setProcessQuantum) and decremented each time this function is called. If the time slice reaches zero, the even
  *  strategy is used to determine the next process to run.
  *
  *  \param processes An array holding the processes to choose the next process from.
@@ -121,27 +378,14 @@ ProcessID os_Scheduler_Random(Process const processes[], ProcessID current) {
  *  \return The next process to be executed determined on the basis of the round robin strategy.
  */
 ProcessID os_Scheduler_RoundRobin(Process const processes[], ProcessID current) {
-	if(processes[current].state == OS_PS_READY && schedulingInfo.timeSlice > 0){
+	ProcessSet const ready = os_getReadySet();
+	if(current != 0 && (ready & PROCESS_BIT(current)) && schedulingInfo.timeSlice > 0){
 		schedulingInfo.timeSlice--;
 		return current;
 	}
-	uint8_t numberOfReadyProcs = 0;
-	for(uint8_t i = 0;i < MAX_NUMBER_OF_PROCESSES;i++){
-		if(processes[i].state == OS_PS_READY){
-			numberOfReadyProcs++;
-		}
-	}
-	if(numberOfReadyProcs == 1){ //When only the idle process is available return pid 0
-		return 0;
-	}
-	uint8_t processWithHighestPriority = 0;
-    for(uint8_t i = 0;i < MAX_NUMBER_OF_PROCESSES;i++){
-		if(processes[i].priority > processWithHighestPriority){
-			processWithHighestPriority = i;
-		}
-	}
-	//os_resetSchedulingInformation(); Lsung?
-	return processWithHighestPriority;
+	ProcessID const next = os_nextProcess(ready, current);
+	schedulingInfo.timeSlice = os_effectiveQuantum(next);
+	return next;
 }
 
 /*!
@@ -156,27 +400,26 @@ ProcessID os_Scheduler_RoundRobin(Process const processes[], ProcessID current)
  *  \return The next process to be executed, determined based on the inactive-aging strategy.
  */
 ProcessID os_Scheduler_InactiveAging(Process const processes[], ProcessID current){
-	    for(uint8_t iterator = 0;iterator < MAX_NUMBER_OF_PROCESSES;iterator++){ // Increasing all ages except idle
-		    if(processes[iterator].state == OS_PS_READY){
-				schedulingInfo.age[iterator] += processes[iterator].priority;
-			}
-	    }
-		uint8_t nextProcess = 0;
-		for(uint8_t iterator = 0;iterator < MAX_NUMBER_OF_PROCESSES;iterator++){ //Increasing all ages except current and idle
-			if(processes[iterator].state == OS_PS_READY && schedulingInfo.age[iterator] >= schedulingInfo.age[nextProcess]){
-				if(schedulingInfo.age[iterator] == schedulingInfo.age[nextProcess] && processes[iterator].priority >= processes[nextProcess].priority){
-					if(processes[iterator].priority > processes[nextProcess].priority){
-						nextProcess = iterator;	
-					} //If priority is the same -> do nothing
-				}else{
-					if(schedulingInfo.age[iterator] > schedulingInfo.age[nextProcess]){
-						nextProcess = iterator;	
-					} //If age is the same -> do nothing
-				}
-			}
-		}
-		schedulingInfo.age[nextProcess] = 0;
-		return nextProcess; //If no one is ready -> idle
+	ProcessSet const ready = os_getReadySet() & ~1; // Exclude idle
+	if(!ready){
+		return 0;
+	}
+	ProcessID nextProcess = os_lowestProcess(ready);
+	// Only visit the members of the ready set, in ascending order
+	for(ProcessSet members = ready; members; members &= members - 1){
+		ProcessID const iterator = os_lowestProcess(members);
+		schedulingInfo.age[iterator] += processes[iterator].priority;
+	}
+	for(ProcessSet members = ready; members; members &= members - 1){
+		ProcessID const iterator = os_lowestProcess(members);
+		if(schedulingInfo.age[iterator] > schedulingInfo.age[nextProcess]
+		   || (schedulingInfo.age[iterator] == schedulingInfo.age[nextProcess]
+		       && processes[iterator].priority > processes[nextProcess].priority)){
+			nextProcess = iterator;
+		} // On a tie the lower ProcessID stays selected
+	}
+	schedulingInfo.age[nextProcess] = processes[nextProcess].priority;
+	return nextProcess;
 }
 
 /*!
@@ -189,27 +432,74 @@ ProcessID os_Scheduler_InactiveAging(Process const processes[], ProcessID curren
  *  \return The next process to be executed, determined based on the run-to-completion strategy.
  */
 ProcessID os_Scheduler_RunToCompletion(Process const processes[], ProcessID current) {
-	if(processes[current].state == OS_PS_READY){
+	ProcessSet const ready = os_getReadySet();
+	if(current != 0 && (ready & PROCESS_BIT(current))){
 		return current;
 	}
-	
-	uint8_t numberOfReadyProcs = 0;
-	for(uint8_t i = 0;i < MAX_NUMBER_OF_PROCESSES;i++){
-		if(processes[i].state == OS_PS_READY){
-			numberOfReadyProcs++;
+	return os_nextProcess(ready, current);
+}
+
+/*!
+ *  This function realizes the earliest-deadline-first strategy for the periodic processes
+ *  (see os_setRealTimeParameters). The time since the last call is charged to the job that ran.
+ *  A job that is not done by its deadline counts as missed and is dropped. Jobs of all periodic
+ *  processes, ready or not, are released when their release time has come, so releases never fall
+ *  behind the wrapping clock. Periods that passed between two calls are skipped. Of the ready jobs
+ *  with budget left, the one with the earliest deadline is chosen. If there is none, the other
+ *  processes share the CPU as with the even strategy.
+ *
+ *  \param processes An array holding the processes to choose the next process from.
+ *  \param current The id of the current process.
+ *  \return The next process to be executed, determined based on the earliest-deadline-first strategy.
+ */
+ProcessID os_Scheduler_EDF(Process const processes[], ProcessID current) {
+	Ticks const ticks = os_ticks();
+	Ticks const elapsed = ticks - schedulingInfo.edfLast;
+	schedulingInfo.edfLast = ticks;
+	uint16_t const now = ticks / EDF_TICK_COUNTS;
+	if(schedulingInfo.edfSet & PROCESS_BIT(current)){
+		EdfInformation* const job = &schedulingInfo.edf[current];
+		if(job->remaining > elapsed){
+			job->remaining -= elapsed;
+		} else if(job->remaining){
+			job->remaining = 0; // Contained until the next release
+			if(job->misses < UINT8_MAX){
+				job->misses++;
+			}
 		}
 	}
-	if(numberOfReadyProcs == 1){ //When only the idle process is available return pid 0
-		return 0;
-	}
-	while(1){ //Find next ready process
-		if(current == 7){ //Cycle through pids
-			current = 1;
-			}else{
-			current++;
+
+	ProcessSet const ready = os_getReadySet() & ~1; // Exclude idle
+	ProcessID next = INVALID_PROCESS;
+	for(ProcessSet members = schedulingInfo.edfSet; members; members &= members - 1){
+		ProcessID const iterator = os_lowestProcess(members);
+		if(processes[iterator].state == OS_PS_UNUSED){
+			continue; // Killed, the slot is reset when it is used again
 		}
-		if(processes[current].state == OS_PS_READY){
-			return current;
+		EdfInformation* const job = &schedulingInfo.edf[iterator];
+		if(job->remaining && EDF_REACHED(now, job->absDeadline)){
+			job->remaining = 0;
+			if(job->misses < UINT8_MAX){
+				job->misses++;
+			}
+		}
+		if(EDF_REACHED(now, job->release)){
+			uint16_t const late = now - job->release;
+			uint16_t const start = now - (late < job->period ? late : late % job->period);
+			job->absDeadline = start + job->deadline;
+			job->release = start + job->period;
+			job->remaining = (Ticks)job->budget * EDF_TICK_COUNTS;
 		}
+		if(!(ready & PROCESS_BIT(iterator))){
+			continue;
+		}
+		if(job->remaining && (next == INVALID_PROCESS
+		   || (int16_t)(job->absDeadline - schedulingInfo.edf[next].absDeadline) < 0)){
+			next = iterator;
+		} // On a tie the lower ProcessID stays selected
+	}
+	if(next != INVALID_PROCESS){
+		return next;
 	}
+	return os_nextProcess(ready & ~schedulingInfo.edfSet, current);
 }
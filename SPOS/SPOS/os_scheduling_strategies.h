@@ -14,16 +14,67 @@
 #include "os_scheduler.h"
 #include "defines.h"
 
+//! Length of the time unit of OS_SS_EDF in timer 0 counts (one overflow, ~3.3 ms)
+#define EDF_TICK_COUNTS 256
+
+//! Longest period, deadline and budget OS_SS_EDF accepts in its time unit (~53 s)
+#define EDF_MAX_TICKS 0x3FFF
+
+//! Real time parameters and the current job of a periodic process, in EDF_TICK_COUNTS units
+typedef struct {
+	uint16_t period;
+	uint16_t deadline;    //!< Relative to the release of a job, at most the period
+	uint16_t budget;      //!< Worst case execution time of a job
+	uint16_t release;     //!< When the next job is released
+	uint16_t absDeadline; //!< Deadline of the current job
+	Ticks remaining;      //!< Budget left to the current job in timer 0 counts, 0 once it is done
+	uint8_t misses;       //!< Jobs that ran out of budget or time (saturating)
+} EdfInformation;
+
 //! Structure used to store specific scheduling informations such as a time slice
 // This is a presence task
 typedef struct {
 	uint8_t timeSlice; 
 	Age age[MAX_NUMBER_OF_PROCESSES];
+	uint8_t quantum[MAX_NUMBER_OF_PROCESSES]; // 0: use the priority
+	EdfInformation edf[MAX_NUMBER_OF_PROCESSES];
+	ProcessSet edfSet;    //!< The periodic processes
+	Ticks edfLast;        //!< Time of the last decision of OS_SS_EDF in timer 0 counts
 } SchedulingInformation;
 
+//! Returns the number of processes in a set
+uint8_t os_countProcesses(ProcessSet set);
+
+//! Returns the process with the lowest ID in a set
+ProcessID os_lowestProcess(ProcessSet set);
+
+//! Returns the process with the highest ID in a set
+ProcessID os_highestProcess(ProcessSet set);
+
+//! Returns the next process after current in a set (cyclic, idle excluded)
+ProcessID os_nextProcess(ProcessSet set, ProcessID current);
+
 //! Used to reset the SchedulingInfo for one process
 void os_resetProcessSchedulingInformation(ProcessID id);
 
+//! Sets the number of ticks a process keeps the CPU under RoundRobin (0 selects its priority)
+void os_setProcessQuantum(ProcessID id, uint8_t quantum);
+
+//! Returns the configured time quantum of a process (0 means its priority is used)
+uint8_t os_getProcessQuantum(ProcessID id);
+
+//! Makes a process periodic under EDF if the admission control accepts it (0 ms period: not periodic)
+bool os_setRealTimeParameters(ProcessID id, Time period, Time deadline, Time budget);
+
+//! Returns how many jobs of a periodic process did not finish within their budget and deadline
+uint8_t os_getDeadlineMisses(ProcessID id);
+
+//! Ends the current job of a periodic process and waits for the release of the next one
+void os_waitForNextPeriod(void);
+
+//! Used to give up the remainder of the current time slice
+void os_dropTimeSlice(void);
+
 //! Used to reset the SchedulingInfo for a strategy
 void os_resetSchedulingInformation(SchedulingStrategy strategy);
 
@@ -42,4 +93,7 @@ ProcessID os_Scheduler_InactiveAging(Process const processes[], ProcessID curren
 //! RunToCompletion strategy
 ProcessID os_Scheduler_RunToCompletion(Process const processes[], ProcessID current);
 
+//! Earliest deadline first strategy
+ProcessID os_Scheduler_EDF(Process const processes[], ProcessID current);
+
 #endif
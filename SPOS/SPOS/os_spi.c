@@ -0,0 +1,41 @@
+#include "os_spi.h"
+#include "util.h"
+
+#include <avr/io.h>
+
+/*! \file
+
+SPI master. Transfers are not protected against interrupts, callers have to
+keep the whole transaction of a chip select atomic.
+
+*/
+
+/*!
+ *  Sets the SPI pins to their directions, deselects the external SRAM and
+ *  enables the SPI module as master in mode 0 at the highest rate.
+ */
+void os_spi_init(void) {
+    DDRB |= (1 << SPI_PIN_CS) | (1 << SPI_PIN_MOSI) | (1 << SPI_PIN_SCK);
+    DDRB &= ~(1 << SPI_PIN_MISO);
+    sbi(PORTB, SPI_PIN_CS);
+    SPCR = (1 << SPE) | (1 << MSTR);
+    SPSR = 1 << SPI2X;
+}
+
+/*!
+ *  \param data The byte to send.
+ *  \return The byte that was received.
+ */
+uint8_t os_spi_send(uint8_t data) {
+    SPDR = data;
+    while (!gbi(SPSR, SPIF)) {
+    }
+    return SPDR;
+}
+
+/*!
+ *  \return The byte that was received.
+ */
+uint8_t os_spi_receive(void) {
+    return os_spi_send(0xFF);
+}
@@ -0,0 +1,42 @@
+/*! \file
+ *  \brief SPI master of the OS.
+ *
+ *  Sends and receives single bytes over the SPI bus of PORTB, which is used
+ *  for the external SRAM.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_SPI_H
+#define _OS_SPI_H
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Chip select of the external SRAM (PB4, which is also SS)
+#define SPI_PIN_CS   4
+
+//! Bits of the SPI pins on PORTB
+#define SPI_PIN_MOSI 5
+#define SPI_PIN_MISO 6
+#define SPI_PIN_SCK  7
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Configures the SPI module as master at F_CPU / 2
+void os_spi_init(void);
+
+//! Sends a byte and returns the byte that was received meanwhile
+uint8_t os_spi_send(uint8_t data);
+
+//! Receives a byte by sending a dummy byte
+uint8_t os_spi_receive(void);
+
+#endif
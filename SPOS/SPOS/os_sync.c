@@ -0,0 +1,319 @@
+#include "os_sync.h"
+#include "os_scheduler.h"
+#include "os_core.h"
+
+#include <avr/interrupt.h>
+
+/*! \file
+
+Mutexes and semaphores. A released mutex or semaphore is handed directly to
+the waiting process with the highest priority, so it cannot be taken away by
+a process that did not wait. Waiting processes stay blocked until they were
+removed from the waiters, so they are not confused by other wakeups.
+
+While a process holds mutexes, it runs with the highest priority of all
+processes waiting for one of them, or its own priority if that is higher.
+This keeps processes with a medium priority from delaying a waiting process
+with a high priority indefinitely. Strategies that use the priority, like
+round robin and inactive aging, then give the owner more processor time
+until it releases the mutexes. The priority is passed on along a chain of
+owners that wait for mutexes themselves. It is recomputed whenever a mutex
+or a waiter comes or goes, and a priority that was set by someone else in
+the meantime (e.g. by the task manager) is kept as the new own priority.
+
+When a process is killed, it stops waiting and the mutexes it held are
+passed on as if it had released them.
+
+*/
+
+//! The priority a process would have without the mutexes it holds
+static Priority basePriority[MAX_NUMBER_OF_PROCESSES];
+
+//! The priority os_mutexUpdatePriority gave a process last
+static Priority appliedPriority[MAX_NUMBER_OF_PROCESSES];
+
+//! The mutexes each process holds, linked by their nextHeld
+static Mutex* heldMutexes[MAX_NUMBER_OF_PROCESSES];
+
+//! The mutex each process waits for (NULL if none)
+static Mutex* waitingFor[MAX_NUMBER_OF_PROCESSES];
+
+//! The set of waiters each process is a member of (NULL if none)
+static ProcessSet* waitingIn[MAX_NUMBER_OF_PROCESSES];
+
+/*!
+ *  Selects the process with the highest priority in a set. Of processes
+ *  with the same priority, the one with the lowest ID is taken.
+ *
+ *  \param set A non-empty set of processes.
+ *  \return The process with the highest priority.
+ */
+static ProcessID os_highestPriority(ProcessSet set) {
+    ProcessID best = INVALID_PROCESS;
+    for (ProcessID pid = 0; pid < MAX_NUMBER_OF_PROCESSES; pid++) {
+        if ((set & PROCESS_BIT(pid))
+            && (best == INVALID_PROCESS || os_getProcessSlot(pid)->priority > os_getProcessSlot(best)->priority)) {
+            best = pid;
+        }
+    }
+    return best;
+}
+
+/*!
+ *  Makes the current process wait until another process removes it from
+ *  the set of waiters. Must be called with interrupts disabled.
+ *
+ *  \param waiters The set of waiters the current process is added to.
+ */
+static void os_waitIn(ProcessSet* waiters) {
+    ProcessID const self = os_getCurrentProc();
+    *waiters |= PROCESS_BIT(self);
+    waitingIn[self] = waiters;
+    while (*waiters & PROCESS_BIT(self)) {
+        os_block();
+    }
+    waitingIn[self] = NULL;
+}
+
+/*!
+ *  Recomputes the priority of a process from its own priority and the
+ *  priorities of the processes that wait for the mutexes it holds.
+ *  Must be called with interrupts disabled.
+ *
+ *  \param pid The process to update.
+ */
+static void os_mutexUpdatePriority(ProcessID pid) {
+    Process* const process = os_getProcessSlot(pid);
+    if (process->priority != appliedPriority[pid]) {
+        basePriority[pid] = process->priority; // Changed by someone else
+    }
+    Priority priority = basePriority[pid];
+    for (Mutex const* mutex = heldMutexes[pid]; mutex; mutex = mutex->nextHeld) {
+        if (mutex->waiters) {
+            Priority const waiting = os_getProcessSlot(os_highestPriority(mutex->waiters))->priority;
+            if (waiting > priority) {
+                priority = waiting;
+            }
+        }
+    }
+    process->priority = priority;
+    appliedPriority[pid] = priority;
+}
+
+/*!
+ *  Updates the priority of the owner of a mutex, and of the owners of the
+ *  mutexes each of them waits for in turn. Must be called with interrupts
+ *  disabled.
+ *
+ *  \param mutex The mutex whose waiters changed.
+ */
+static void os_mutexPropagate(Mutex const* mutex) {
+    // Bounded, as the owners may wait for each other in a deadlock
+    for (uint8_t depth = 0; mutex && mutex->owner != INVALID_PROCESS && depth < MAX_NUMBER_OF_PROCESSES; depth++) {
+        os_mutexUpdatePriority(mutex->owner);
+        mutex = waitingFor[mutex->owner];
+    }
+}
+
+/*!
+ *  Makes a process the owner of a free mutex. Must be called with
+ *  interrupts disabled.
+ *
+ *  \param mutex The mutex to take.
+ *  \param pid The new owner.
+ */
+static void os_mutexTake(Mutex* mutex, ProcessID pid) {
+    if (!heldMutexes[pid]) {
+        basePriority[pid] = appliedPriority[pid] = os_getProcessSlot(pid)->priority;
+    }
+    mutex->owner = pid;
+    mutex->nextHeld = heldMutexes[pid];
+    heldMutexes[pid] = mutex;
+}
+
+/*!
+ *  Takes a mutex from its owner, whose priority is recomputed, and passes
+ *  it to the waiter with the highest priority. Must be called with
+ *  interrupts disabled.
+ *
+ *  \param mutex A mutex that has an owner.
+ */
+static void os_mutexRelease(Mutex* mutex) {
+    ProcessID const owner = mutex->owner;
+    for (Mutex** link = &heldMutexes[owner]; *link; link = &(*link)->nextHeld) {
+        if (*link == mutex) {
+            *link = mutex->nextHeld;
+            break;
+        }
+    }
+    mutex->nextHeld = NULL;
+    os_mutexUpdatePriority(owner);
+    if (mutex->waiters) {
+        ProcessID const next = os_highestPriority(mutex->waiters);
+        mutex->waiters &= ~PROCESS_BIT(next);
+        waitingFor[next] = NULL;
+        os_mutexTake(mutex, next);
+        os_mutexUpdatePriority(next);
+        os_unblock(next);
+    } else {
+        mutex->owner = INVALID_PROCESS;
+    }
+}
+
+/*!
+ *  \param mutex The mutex to initialize.
+ */
+void os_mutexInit(Mutex* mutex) {
+    *mutex = (Mutex)MUTEX_INITIALIZER;
+}
+
+/*!
+ *  Takes the mutex. If another process holds it, the current process is
+ *  blocked until the mutex is passed to it, and the owner (and the owners
+ *  it waits for) inherit its priority if that is higher. A process must not
+ *  lock a mutex it holds.
+ *
+ *  \param mutex The mutex to take.
+ */
+void os_mutexLock(Mutex* mutex) {
+    ProcessID const self = os_getCurrentProc();
+    uint8_t const sreg = SREG;
+    cli();
+    if (mutex->owner == self) {
+        SREG = sreg;
+        os_errorPStr(PSTR("Mutex locked twice"));
+        return;
+    }
+    if (mutex->owner == INVALID_PROCESS) {
+        os_mutexTake(mutex, self);
+    } else {
+        mutex->waiters |= PROCESS_BIT(self);
+        waitingFor[self] = mutex;
+        os_mutexPropagate(mutex);
+        os_waitIn(&mutex->waiters);
+    }
+    SREG = sreg;
+}
+
+/*!
+ *  Takes the mutex without waiting.
+ *
+ *  \param mutex The mutex to take.
+ *  \return True iff the mutex was free and is now held by the current process.
+ */
+bool os_mutexTryLock(Mutex* mutex) {
+    uint8_t const sreg = SREG;
+    cli();
+    bool const taken = mutex->owner == INVALID_PROCESS;
+    if (taken) {
+        os_mutexTake(mutex, os_getCurrentProc());
+    }
+    SREG = sreg;
+    return taken;
+}
+
+/*!
+ *  Releases the mutex. The priority the current process inherited through
+ *  it is dropped, the other mutexes it holds still count. If processes are
+ *  waiting, the one with the highest priority becomes the owner and is
+ *  unblocked.
+ *
+ *  \param mutex The mutex to release, must be held by the current process.
+ */
+void os_mutexUnlock(Mutex* mutex) {
+    uint8_t const sreg = SREG;
+    cli();
+    if (mutex->owner != os_getCurrentProc()) {
+        SREG = sreg;
+        os_errorPStr(PSTR("Mutex not owned"));
+        return;
+    }
+    os_mutexRelease(mutex);
+    SREG = sreg;
+}
+
+/*!
+ *  \param semaphore The semaphore to initialize.
+ *  \param count The number of resources that are available.
+ */
+void os_semaphoreInit(Semaphore* semaphore, uint8_t count) {
+    *semaphore = (Semaphore)SEMAPHORE_INITIALIZER(count);
+}
+
+/*!
+ *  Takes a resource. If there is none, the current process is blocked
+ *  until a resource is passed to it.
+ *
+ *  \param semaphore The semaphore to take a resource from.
+ */
+void os_semaphoreWait(Semaphore* semaphore) {
+    uint8_t const sreg = SREG;
+    cli();
+    if (semaphore->count) {
+        semaphore->count--;
+    } else {
+        os_waitIn(&semaphore->waiters);
+    }
+    SREG = sreg;
+}
+
+/*!
+ *  Takes a resource without waiting. May be called from an ISR.
+ *
+ *  \param semaphore The semaphore to take a resource from.
+ *  \return True iff a resource was taken.
+ */
+bool os_semaphoreTryWait(Semaphore* semaphore) {
+    uint8_t const sreg = SREG;
+    cli();
+    bool const available = semaphore->count;
+    if (available) {
+        semaphore->count--;
+    }
+    SREG = sreg;
+    return available;
+}
+
+/*!
+ *  Returns a resource. If processes are waiting, the resource is passed to
+ *  the one with the highest priority, which is unblocked. May be called
+ *  from an ISR.
+ *
+ *  \param semaphore The semaphore to return a resource to.
+ */
+void os_semaphoreSignal(Semaphore* semaphore) {
+    uint8_t const sreg = SREG;
+    cli();
+    if (semaphore->waiters) {
+        ProcessID const next = os_highestPriority(semaphore->waiters);
+        semaphore->waiters &= ~PROCESS_BIT(next);
+        os_unblock(next);
+    } else if (semaphore->count < UINT8_MAX) {
+        semaphore->count++;
+    }
+    SREG = sreg;
+}
+
+/*!
+ *  Called by os_kill. The process is removed from the waiters it is a
+ *  member of, so nothing is passed to it any more, and the owner it waited
+ *  for loses the priority it inherited from it. The mutexes it held are
+ *  released and passed on to their waiters.
+ *
+ *  \param pid The process that is killed.
+ */
+void os_freeProcessSync(ProcessID pid) {
+    uint8_t const sreg = SREG;
+    cli();
+    if (waitingIn[pid]) {
+        *waitingIn[pid] &= ~PROCESS_BIT(pid);
+        waitingIn[pid] = NULL;
+    }
+    Mutex const* const waited = waitingFor[pid];
+    waitingFor[pid] = NULL;
+    os_mutexPropagate(waited);
+    while (heldMutexes[pid]) {
+        os_mutexRelease(heldMutexes[pid]);
+    }
+    SREG = sreg;
+}
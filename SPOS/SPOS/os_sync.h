@@ -0,0 +1,75 @@
+/*! \file
+ *  \brief Blocking synchronization primitives of the OS.
+ *
+ *  Mutexes with priority inheritance and counting semaphores. Processes
+ *  that wait for them are blocked, so all other processes keep running.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_SYNC_H
+#define _OS_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "defines.h"
+#include "os_process.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! A lock that is held by at most one process at a time
+typedef struct Mutex {
+    ProcessID owner;            //!< The process holding the mutex (INVALID_PROCESS if free)
+    ProcessSet waiters;         //!< Processes that are blocked in os_mutexLock
+    struct Mutex* nextHeld;     //!< The next mutex the owner holds
+} Mutex;
+
+//! A counter of available resources
+typedef struct {
+    uint8_t count;              //!< Number of resources that can be taken without waiting
+    ProcessSet waiters;         //!< Processes that are blocked in os_semaphoreWait
+} Semaphore;
+
+//! Initializer for a free mutex
+#define MUTEX_INITIALIZER { .owner = INVALID_PROCESS, .waiters = 0, .nextHeld = NULL }
+
+//! Initializer for a semaphore with COUNT resources
+#define SEMAPHORE_INITIALIZER(COUNT) { .count = (COUNT), .waiters = 0 }
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Initializes a free mutex
+void os_mutexInit(Mutex* mutex);
+
+//! Takes the mutex, blocks the current process while another one holds it
+void os_mutexLock(Mutex* mutex);
+
+//! Takes the mutex if it is free
+bool os_mutexTryLock(Mutex* mutex);
+
+//! Releases the mutex and passes it to the waiter with the highest priority
+void os_mutexUnlock(Mutex* mutex);
+
+//! Initializes a semaphore with the given number of resources
+void os_semaphoreInit(Semaphore* semaphore, uint8_t count);
+
+//! Takes a resource, blocks the current process while there is none
+void os_semaphoreWait(Semaphore* semaphore);
+
+//! Takes a resource if there is one
+bool os_semaphoreTryWait(Semaphore* semaphore);
+
+//! Returns a resource and passes it to the waiter with the highest priority
+void os_semaphoreSignal(Semaphore* semaphore);
+
+//! Releases the mutexes of a process that is killed and stops its waiting
+void os_freeProcessSync(ProcessID pid);
+
+#endif
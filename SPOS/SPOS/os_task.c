@@ -0,0 +1,137 @@
+#include "os_task.h"
+#include "os_scheduler.h"
+
+#include <avr/interrupt.h>
+
+/*! \file
+
+Run-to-completion tasks as known from TinyOS. Every level has a queue of
+posted tasks. A service process takes the oldest task of the highest level
+that is not empty and calls it with interrupts enabled. A task runs until it
+returns and is not preempted by other tasks, so all tasks share the stack of
+the service process and a pending task only takes up its queue entry.
+
+*/
+
+// The pending mask has one bit per level
+#if OS_TASK_LEVELS > 8
+#error "OS_TASK_LEVELS must not exceed 8"
+#endif
+
+//! The posted tasks of every level, each queue is a ring
+static Task* taskQueue[OS_TASK_LEVELS][OS_TASK_QUEUE_SIZE];
+
+//! Index of the oldest task in the queue of every level
+static uint8_t taskHead[OS_TASK_LEVELS];
+
+//! Number of tasks in the queue of every level
+static uint8_t taskCount[OS_TASK_LEVELS];
+
+//! Bit i is set iff the queue of level i is not empty
+static volatile uint8_t taskPending = 0;
+
+//! The service process running the tasks (INVALID_PROCESS before it runs)
+static ProcessID taskServicePid = INVALID_PROCESS;
+
+static Program os_taskService;
+
+/*!
+ *  Checks whether the service process is running.
+ *
+ *  \return True iff the service process exists.
+ */
+static bool os_taskServiceRunning(void) {
+    if (taskServicePid == INVALID_PROCESS) {
+        return false;
+    }
+    Process const* const service = os_getProcessSlot(taskServicePid);
+    return service->state != OS_PS_UNUSED && service->program == os_taskService;
+}
+
+/*!
+ *  Makes sure the service process is running. It is started again if it
+ *  was killed. Tasks that were posted while there was no service process
+ *  are run as soon as it is started.
+ *  Must not be called from an ISR.
+ *
+ *  \return True iff the service process is running.
+ */
+bool os_startTaskService(void) {
+    // Two processes posting at the same time must not both start a service
+    os_enterCriticalSection();
+    if (!os_taskServiceRunning()) {
+        taskServicePid = os_execStack(os_taskService, OS_TASK_PRIORITY, OS_TASK_STACK_SIZE);
+    }
+    bool const running = taskServicePid != INVALID_PROCESS;
+    os_leaveCriticalSection();
+    return running;
+}
+
+/*!
+ *  Posts a task with OS_TASK_LEVEL_DEFAULT, see os_postLevel.
+ *
+ *  \param task The function to run.
+ *  \return False if the queue is full.
+ */
+bool os_post(Task* task) {
+    return os_postLevel(task, OS_TASK_LEVEL_DEFAULT);
+}
+
+/*!
+ *  Appends a task to the queue of its level. It runs after all tasks of
+ *  higher levels and all tasks of the same level that were posted before.
+ *  A task may be posted several times, even by itself, and then runs as
+ *  often as it was posted. May be called from an ISR.
+ *  The service process is started by the first post with interrupts
+ *  enabled. If tasks are only posted from ISRs, os_startTaskService has to
+ *  be called by a process once.
+ *
+ *  \param task The function to run.
+ *  \param level The level of the task, below OS_TASK_LEVELS.
+ *  \return False if the task or the level is invalid or the queue is full.
+ */
+bool os_postLevel(Task* task, TaskLevel level) {
+    if (!task || level >= OS_TASK_LEVELS) {
+        return false;
+    }
+    uint8_t const sreg = SREG;
+    if ((sreg & (1 << SREG_I)) && !os_startTaskService()) {
+        return false;
+    }
+    cli();
+    if (taskCount[level] == OS_TASK_QUEUE_SIZE) {
+        SREG = sreg;
+        return false;
+    }
+    taskQueue[level][(taskHead[level] + taskCount[level]) % OS_TASK_QUEUE_SIZE] = task;
+    taskCount[level]++;
+    taskPending |= 1 << level;
+    os_unblock(taskServicePid);
+    SREG = sreg;
+    return true;
+}
+
+/*!
+ *  The service process. It blocks until tasks are posted and then runs
+ *  the oldest task of the highest level with interrupts enabled, one
+ *  after another.
+ */
+static void os_taskService(void) {
+    for (;;) {
+        cli();
+        while (!taskPending) {
+            os_block();
+        }
+        TaskLevel level = OS_TASK_LEVELS - 1;
+        while (!(taskPending & (1 << level))) {
+            level--;
+        }
+        Task* const task = taskQueue[level][taskHead[level]];
+        taskHead[level] = (taskHead[level] + 1) % OS_TASK_QUEUE_SIZE;
+        if (!--taskCount[level]) {
+            taskPending &= ~(1 << level);
+        }
+        sei();
+        task();
+    }
+}
@@ -0,0 +1,46 @@
+/*! \file
+ *  \brief Run-to-completion tasks of the OS.
+ *
+ *  Short jobs that are posted to a queue and run one after another on the
+ *  stack of a single service process instead of occupying a process each.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_TASK_H
+#define _OS_TASK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "defines.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! This is the type of a task (not the pointer to one!)
+typedef void Task(void);
+
+//! The level of a task, tasks of higher levels run first
+typedef uint8_t TaskLevel;
+
+//! The level os_post uses
+#define OS_TASK_LEVEL_DEFAULT       0
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Posts a task with the default level
+bool os_post(Task* task);
+
+//! Posts a task with the given level
+bool os_postLevel(Task* task, TaskLevel level);
+
+//! Starts the process that runs the posted tasks
+bool os_startTaskService(void);
+
+#endif
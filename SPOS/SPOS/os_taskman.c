@@ -30,15 +30,18 @@ Page specification;
 #include "lcd.h"
 
 #include <stdint.h>
+#include <avr/interrupt.h>
 
 /* INTERFACE TO SPOS *****************************/
 
 #include "os_process.h"
 #include "os_scheduler.h"
+#include "os_scheduling_strategies.h"
 #include "os_input.h"
 #include "os_user_privileges.h"
 #if (VERSUCH >= 3)
     #include "os_memory.h"
+    #include "os_pool.h"
 #endif
 
 #pragma GCC push_options
@@ -52,6 +55,8 @@ Program* os_getProgramSlot(Program);
 /*!
  *  Specifies to what depth pages of the TM can be nested.
  *  This is hard coded, because we have to allocate stack space before calling the pages.
+ *  It is taken from the scheduler stack or, with OS_TASKMAN_PROCESS, from the
+ *  stack of the TM process.
  *  If this value is too small, you will not be able to descend beyond the given level.
  */
 #define TM_NESTING_DEPTH 6
@@ -80,6 +85,18 @@ Program* os_getProgramSlot(Program);
  */
 #define TM_COMPILE_HEAP_SUPPORT (VERSUCH >= 3)
 
+/*!
+ *  Does the scheduler time its process switches?
+ *  This is enabled with OS_SCHEDULER_STATS in defines.h.
+ */
+#define TM_COMPILE_STATS_SUPPORT (OS_SCHEDULER_STATS)
+
+/*!
+ *  Does the idle process measure the peak stack usage?
+ *  This is enabled with OS_STACK_WATERMARK in defines.h.
+ */
+#define TM_COMPILE_WATERMARK_SUPPORT (OS_STACK_WATERMARK)
+
 /*!
  *  The number of main-pages of the TM. Actually, this is set by
  *  the respective page-handler at runtime.
@@ -100,6 +117,20 @@ Program* os_getProgramSlot(Program);
  */
 #define TM_MAP_ENTRIES_PER_PAGE 20
 
+/*!
+ *  How long the TM process sleeps between polls of the buttons (in ms), so
+ *  that the other processes keep running while the TM waits for input.
+ */
+#define TM_POLL_INTERVAL 20
+
+#if OS_TASKMAN_PROCESS
+//! Lets the other processes run while the TM waits for input.
+#define tm_pause() os_sleep(TM_POLL_INTERVAL)
+#else
+//! Nothing else runs while the TM is open inside the scheduler ISR.
+#define tm_pause()
+#endif
+
 /*!
  *  This is a wrapper for the os_getInput function of the os_input module.
  *  It is never used directly but utilizes a macro to use a stack variable as inputBuffer.
@@ -243,6 +274,88 @@ bool os_taskManOpen() {
     return tm_open;
 }
 
+#if OS_TASKMAN_PROCESS
+
+//! The process the TM runs in (INVALID_PROCESS before it is started)
+static ProcessID tm_pid = INVALID_PROCESS;
+
+//! Set by the scheduler when the user asks for the TM
+static volatile bool tm_requested = false;
+
+static Program os_taskManProcess;
+
+/*!
+ *  Checks whether the TM process is running.
+ *
+ *  \return True iff the TM process exists.
+ */
+static bool os_taskManRunning(void) {
+    if (tm_pid == INVALID_PROCESS) {
+        return false;
+    }
+    Process const* const tm = os_getProcessSlot(tm_pid);
+    return tm->state != OS_PS_UNUSED && tm->program == os_taskManProcess;
+}
+
+/*!
+ *  Makes sure the TM process is running. It is started by the scheduler
+ *  and started again if a program killed it. Must not be called from an ISR.
+ *
+ *  \return True iff the TM process is running.
+ */
+bool os_startTaskMan(void) {
+    // Two processes must not both start a TM process
+    os_enterCriticalSection();
+    if (!os_taskManRunning()) {
+        tm_open = false;
+        tm_pid = os_execStack(os_taskManProcess, OS_TASKMAN_PRIORITY, OS_TASKMAN_STACK_SIZE);
+    }
+    bool const running = tm_pid != INVALID_PROCESS;
+    os_leaveCriticalSection();
+    return running;
+}
+
+/*!
+ *  Wakes the TM process to open the TM. Called by the scheduler when the
+ *  user presses the buttons. Requests while the TM is open are dropped.
+ *
+ *  \return False if there is no TM process to open the TM.
+ */
+bool os_requestTaskMan(void) {
+    if (!os_taskManRunning()) {
+        return false;
+    }
+    // While the TM is open it sleeps between polls, it must not be woken
+    if (tm_open || tm_requested) {
+        return true;
+    }
+    tm_requested = true;
+    os_unblock(tm_pid);
+    return true;
+}
+
+/*!
+ *  The program of the TM process. It blocks until the TM is requested and
+ *  then runs os_taskManMain, with the page stack on its own stack.
+ */
+static void os_taskManProcess(void) {
+    for (;;) {
+        cli();
+        while (!tm_requested) {
+            os_block(); // Returns with interrupts disabled again
+        }
+        sei();
+        os_waitForNoInput();
+        os_taskManMain();
+#if OS_INPUT_EVENTS
+        os_flushInputEvents(); // The TM consumed these buttons
+#endif
+        tm_requested = false;
+    }
+}
+
+#endif
+
 /*!
  *  This is the main entry point for the TM, as invoked e.g. from the
  *  scheduler.
@@ -288,7 +401,9 @@ void os_taskManMain(void) {
             }
 
             // Wait for confirmation (OK+ES)
-            while (os_getInput() != (1 | (1 << 3)));
+            while (os_getInput() != (1 | (1 << 3))) {
+                tm_pause();
+            }
             os_waitForNoInput();
             return;
 
@@ -391,7 +506,9 @@ void os_taskManMain(void) {
                  * process it, we will still know it was pressed (updateInput() has
                  * heavy side effects, as it is a macro).
                  */
-                while (!updateInput());
+                while (!updateInput()) {
+                    tm_pause();
+                }
             }
             newInput = true;
             if (READ_BTN(ES) || !pageResult.success) {
@@ -420,7 +537,9 @@ void os_taskManMain(void) {
                  */
                 newInput = false;
             }
-            while (updateInput());
+            while (updateInput()) {
+                tm_pause();
+            }
         } while (!newInput);
         // This can occur if our design-time estimate of the stack size was too small.
         // { stack.top + 1 != 0 }
@@ -439,6 +558,8 @@ char PROGMEM const mainLabels[] =
     "Change Priority                \0"
     "Change Scheduling Strategy     \0"
     "Heap(s)                        \0"
+    "Scheduler Statistics           \0"
+    "Process Stacks                 \0"
 ;
 
 // Forward declarations for the sub-pages of the root-page.
@@ -460,6 +581,12 @@ static tm_page tm_scheduling;
 static tm_page tm_heap;
 #endif
 
+#if TM_COMPILE_STATS_SUPPORT
+static tm_page tm_stats;
+#endif
+
+static tm_page tm_stacks;
+
 static tm_page tm_null;
 
 // A convenience macro to access the stack-history.
@@ -471,14 +598,25 @@ static tm_page tm_null;
 #define MAX4(Xa,X3...) (MAX2(Xa,(MAX3(X3))))
 #define MAX5(Xa,X4...) (MAX2(Xa,(MAX4(X4))))
 #define MAX6(Xa,X5...) (MAX2(Xa,(MAX5(X5))))
+#define MAX7(Xa,X6...) (MAX2(Xa,(MAX6(X6))))
 
 #if TM_COMPILE_SCHEDULING_SUPPORT
 #if VERSUCH >= 5
-    #define SS_MAX_COUNT (MAX6(OS_SS_RUN_TO_COMPLETION, OS_SS_RANDOM, OS_SS_EVEN, OS_SS_ROUND_ROBIN, OS_SS_INACTIVE_AGING, OS_SS_MULTI_LEVEL_FEEDBACK_QUEUE) + 1)
+    #define SS_MAX_COUNT (MAX7(OS_SS_RUN_TO_COMPLETION, OS_SS_RANDOM, OS_SS_EVEN, OS_SS_ROUND_ROBIN, OS_SS_INACTIVE_AGING, OS_SS_EDF, OS_SS_MULTI_LEVEL_FEEDBACK_QUEUE) + 1)
 #else
-    #define SS_MAX_COUNT (MAX5(OS_SS_RUN_TO_COMPLETION, OS_SS_RANDOM, OS_SS_EVEN, OS_SS_ROUND_ROBIN, OS_SS_INACTIVE_AGING) + 1)
+    #define SS_MAX_COUNT (MAX6(OS_SS_RUN_TO_COMPLETION, OS_SS_RANDOM, OS_SS_EVEN, OS_SS_ROUND_ROBIN, OS_SS_INACTIVE_AGING, OS_SS_EDF) + 1)
+#endif
+
+// The scheduling page lists the tick period and the time quanta after the strategies
+#define SS_TICK_PAGE    (SS_MAX_COUNT)
+#define SS_QUANTUM_PAGE (SS_MAX_COUNT + 1)
+#define SS_PAGE_COUNT   (SS_MAX_COUNT + 2)
+
 #endif
 
+#if TM_COMPILE_STATS_SUPPORT
+// One page for the switch time, one per phase and one per process
+#define TM_STATS_PAGES (1 + OS_STAT_PHASE_COUNT + MAX_NUMBER_OF_PROCESSES)
 #endif
 
 #if TM_COMPILE_HEAP_SUPPORT
@@ -513,11 +651,15 @@ static TM_PAGE(tm_rootpage) {
         SUBP(2, tm_priority, os_getCurrentProc(), MAX_NUMBER_OF_PROCESSES)
 #endif
 #if TM_COMPILE_SCHEDULING_SUPPORT
-        SUBP(3, tm_scheduling, os_getSchedulingStrategy(), SS_MAX_COUNT)
+        SUBP(3, tm_scheduling, os_getSchedulingStrategy(), SS_PAGE_COUNT)
 #endif
 #if TM_COMPILE_HEAP_SUPPORT
         SUBP(4, tm_heap, 0, TM_HEAP_SUPPORT)
 #endif
+#if TM_COMPILE_STATS_SUPPORT
+        SUBP(5, tm_stats, 0, TM_STATS_PAGES)
+#endif
+        SUBP(6, tm_stacks, os_getCurrentProc(), MAX_NUMBER_OF_PROCESSES)
 #undef SUBP
         default:
             result->child.call = tm_null;
@@ -640,6 +782,36 @@ make_pagehandler(tm_frontpage, tm_null, 0, 0, OS_PR_FRONTPAGE, null, 0) {
     return true;
 }
 
+/*!
+ *  The page to show where the stack of a process lies and how much of it
+ *  is still free. With stack painting, the peak usage is shown instead of
+ *  the currently free part.
+ */
+make_pagehandler(tm_stacks, tm_null, 0, 0, OS_PR_ALWAYS_ALLOW, null, 0) {
+    ProcessID const pid = peekStack(0).param;
+    Process const* const process = os_getProcessSlot(pid);
+    if (process->state == OS_PS_UNUSED) {
+        return false;
+    }
+    lcd_writeProgString(PSTR("Stk #"));
+    lcd_writeDec(pid);
+    lcd_writeChar(' ');
+    lcd_writeHexWord(process->stackLimit);
+    lcd_writeChar('-');
+    lcd_writeHexWord(process->stackBottom);
+    lcd_line2();
+    lcd_writeDec(process->stackBottom - process->stackLimit + 1);
+#if TM_COMPILE_WATERMARK_SUPPORT
+    lcd_writeProgString(PSTR("B, peak "));
+    lcd_writeDec(os_getStackPeak(pid));
+#else
+    lcd_writeProgString(PSTR("B, "));
+    lcd_writeDec(process->sp.as_int + 1 - process->stackLimit);
+    lcd_writeProgString(PSTR(" free"));
+#endif
+    return true;
+}
+
 // XXX slightly ugly
 #define uniqState(state) (((uint32_t)1) << (state))
 
@@ -723,6 +895,12 @@ make_pagehandler(tm_killProc, tm_killProc_kill, 0, 1, OS_PR_KILL_SELECT, pid, pe
     return procMutator(p, PSTR("Kill"), ~uniqState(OS_PS_UNUSED));
 }
 
+#if OS_TASKMAN_PROCESS
+bool internalKill(ProcessID pid){
+  // The TM cannot take itself down, nobody could open it again
+  return pid != os_getCurrentProc() && os_kill(pid);
+}
+#else
 extern ProcessID currentProc;
 bool internalKill(ProcessID pid){
   ProcessID tmp = currentProc;
@@ -731,6 +909,7 @@ bool internalKill(ProcessID pid){
   currentProc = tmp;
   return result;
 }
+#endif
 
 /*!
  *  The page to kill a previously selected process.
@@ -955,15 +1134,51 @@ makeStrategyNameLookup(getSchedulingStratNames, 0x18, 0,
     {OS_SS_EVEN,                      PSTR("<Even>                 ")},
     {OS_SS_ROUND_ROBIN,               PSTR("<Round Robin>          ")},
     {OS_SS_INACTIVE_AGING,            PSTR("<Inactive Aging>       ")},
+    {OS_SS_EDF,                       PSTR("<Earliest Deadline>    ")},
     #if VERSUCH >= 5
     {OS_SS_MULTI_LEVEL_FEEDBACK_QUEUE, PSTR("<MLFQ>                 ")},
     #endif
 )
 
+static tm_page tm_tick_changeH;
+static tm_page tm_quantum;
+
 /*!
  *  The page to select a scheduling strategy to set.
+ *  The last two entries lead to the tick period and the time quanta instead.
  */
 make_pagehandler(tm_scheduling, tm_scheduling_set, 0, 1, OS_PR_SCHEDULING_SELECT, ss, peekStack(0).param) {
+    uint16_t const select = peekStack(0).param;
+    if (select == SS_TICK_PAGE) {
+        uint8_t const period = os_getTickPeriod();
+        result->call = tm_tick_changeH;
+        result->param = period >> 4;
+        result->range = 16;
+        lcd_writeProgString(PSTR("Tick period"));
+        lcd_line2();
+        lcd_writeProgString(PSTR("0x"));
+        lcd_writeHexByte(period);
+        lcd_writeProgString(PSTR(" = "));
+        // Timer 2 counts once every 1024 CPU cycles
+        lcd_writeDec((uint32_t)period * 1024 * 1000 / (F_CPU / 1000));
+        lcd_writeProgString(PSTR("us"));
+        return true;
+    }
+    if (select == SS_QUANTUM_PAGE) {
+        result->call = tm_quantum;
+        result->param = os_getCurrentProc();
+        result->range = MAX_NUMBER_OF_PROCESSES;
+        lcd_writeProgString(PSTR("Time quanta"));
+        lcd_line2();
+        lcd_writeProgString(PSTR("(Round Robin)"));
+        return true;
+    }
+#ifdef OS_FIXED_SCHEDULING_STRATEGY
+    // The other strategies are not part of the build
+    if (select != OS_FIXED_SCHEDULING_STRATEGY) {
+        return false;
+    }
+#endif
     return strategySelector(p, getSchedulingStratNames, os_getSchedulingStrategy());
 }
 
@@ -979,6 +1194,216 @@ make_pagehandler(tm_scheduling_set, tm_null, 0, 0, OS_PR_SCHEDULING, ss, peekSta
                            setSS, 0);
 }
 
+/*!
+ *  The page to change the high nibble of the tick period.
+ */
+make_pagehandler(tm_tick_changeH, tm_tick_changeL, 0, 16, OS_PR_SCHEDULING, null, 0) {
+    // Index to start the sub-page with.
+    result->param = os_getTickPeriod() & 0xF;
+    lcd_writeProgString(PSTR("Tick period"));
+    lcd_line2();
+    lcd_writeProgString(spaces16 + (16 - 2));
+    lcd_writeChar('*');
+    lcd_writeProgString(spaces16 + (16 - 2));
+    lcd_writeChar('[');
+    lcd_writeHexNibble(peekStack(0).param);
+    lcd_writeChar(']');
+    lcd_writeHexNibble(os_getTickPeriod());
+    return true;
+}
+
+/*!
+ *  The page to change the low nibble of the tick period.
+ *  Note that the high nibble is taken from the parameter stack!
+ */
+make_pagehandler(tm_tick_changeL, tm_tick_set, 0, 1, OS_PR_SCHEDULING, null, 0) {
+    lcd_writeProgString(PSTR("Tick period"));
+    lcd_line2();
+    lcd_writeProgString(spaces16 + (16 - 2));
+    lcd_writeChar('*');
+    lcd_writeProgString(spaces16 + (16 - 2));
+    lcd_writeHexNibble(peekStack(1).param);
+    lcd_writeChar('[');
+    lcd_writeHexNibble(peekStack(0).param);
+    lcd_writeChar(']');
+    return true;
+}
+
+/*!
+ *  The page to commit the tick period chosen in the previous two pages.
+ *  Periods below MIN_TICK_PERIOD are rejected.
+ */
+make_pagehandler(tm_tick_set, tm_null, 0, 0, OS_PR_SCHEDULING, null, 0) {
+    uint8_t const period = ((peekStack(2).param & 0xF) << 4)
+                           + (peekStack(1).param & 0xF);
+    lcd_writeProgString(PSTR("Setting tick"));
+    if (period < MIN_TICK_PERIOD) {
+        tm_fail();
+        return true;
+    }
+    os_setTickPeriod(period);
+    tm_done();
+    lcd_writeProgString(PSTR(", now: "));
+    lcd_writeHexByte(os_getTickPeriod());
+    return true;
+}
+
+/*!
+ *  A convenience routine to render the quantum of a process, including
+ *  a mark to indicate that the quantum is being changed.
+ *  \param proc The process id for which to render the quantum.
+ */
+static void quantumConstText(uint16_t proc) {
+    lcd_writeProgString(PSTR("Quantum of #"));
+    lcd_writeDec(proc);
+    lcd_line2();
+    lcd_writeProgString(spaces16 + (16 - 2));
+    lcd_writeChar('*');
+    lcd_writeProgString(spaces16 + (16 - 2));
+}
+
+/*!
+ *  The page to select a process to change its time quantum.
+ */
+make_pagehandler(tm_quantum, tm_quantum_changeH, 0, 16, OS_PR_PRIORITY_SELECT, pid, peekStack(0).param) {
+    uint16_t const proc = peekStack(0).param;
+    if (os_getProcessSlot(proc)->state == OS_PS_UNUSED) {
+        return false;
+    }
+    uint8_t const quantum = os_getProcessQuantum(proc);
+    // Index to start the sub-page with.
+    result->param = quantum >> 4;
+    lcd_writeProgString(PSTR("Qntm proc #"));
+    lcd_writeDec(proc);
+    lcd_line2();
+    if (quantum) {
+        lcd_writeHexByte(quantum);
+        lcd_writeProgString(PSTR(" ticks"));
+    } else {
+        lcd_writeProgString(PSTR("as priority"));
+    }
+    return true;
+}
+
+/*!
+ *  The page to change the high nibble of the quantum of a
+ *  previously selected process.
+ */
+make_pagehandler(tm_quantum_changeH, tm_quantum_changeL, 0, 16, OS_PR_PRIORITY, pid, peekStack(1).param) {
+    uint16_t const proc = peekStack(1).param;
+    // Index to start the sub-page with.
+    result->param = os_getProcessQuantum(proc) & 0xF;
+    quantumConstText(proc);
+    lcd_writeChar('[');
+    lcd_writeHexNibble(peekStack(0).param);
+    lcd_writeChar(']');
+    lcd_writeHexNibble(os_getProcessQuantum(proc));
+    return true;
+}
+
+/*!
+ *  The page to change the low nibble of the quantum of a
+ *  previously selected process.
+ *  Note that the high nibble is taken from the parameter stack!
+ */
+make_pagehandler(tm_quantum_changeL, tm_quantum_set, 0, 1, OS_PR_PRIORITY, pid, peekStack(2).param) {
+    quantumConstText(peekStack(2).param);
+    lcd_writeHexNibble(peekStack(1).param);
+    lcd_writeChar('[');
+    lcd_writeHexNibble(peekStack(0).param);
+    lcd_writeChar(']');
+    return true;
+}
+
+/*!
+ *  The page to commit the quantum for a previously selected process.
+ *  A quantum of 0 makes the process use its priority again.
+ */
+make_pagehandler(tm_quantum_set, tm_null, 0, 0, OS_PR_PRIORITY, pid, peekStack(3).param) {
+    lcd_writeProgString(PSTR("Setting quantum"));
+    os_setProcessQuantum(peekStack(3).param,
+                         ((peekStack(2).param & 0xF) << 4)
+                         + (peekStack(1).param & 0xF));
+    tm_done();
+    lcd_writeProgString(PSTR(", now: "));
+    lcd_writeHexByte(os_getProcessQuantum(peekStack(3).param));
+    return true;
+}
+
+#endif
+
+#if TM_COMPILE_STATS_SUPPORT
+
+//! Converts timer 0 counts into microseconds (below 2^24 counts, so sums are averaged first)
+#define countsToUs(COUNTS) ((uint32_t)(COUNTS) * TC0_PRESCALER / (F_CPU / 1000000ul))
+
+//! The names of the phases of a process switch, 16 characters each
+static char PROGMEM const phaseLabels[] =
+    // 123456789abcdef0
+    "Stack checksum \0"
+    "Input poll     \0"
+    "Strategy       \0"
+    "Stack check    \0"
+;
+
+/*!
+ *  The page to show how long process switches take. The first page shows
+ *  the total time of a switch, followed by one page for the average duration
+ *  of each phase and one page for the CPU share of each process.
+ *  Hitting enter on the first page resets all statistics.
+ */
+make_pagehandler(tm_stats, tm_stats_reset, 0, 1, OS_PR_ALWAYS_ALLOW, null, 0) {
+    uint16_t const page = peekStack(0).param;
+    SchedulerStats const* const stats = os_getSchedulerStats();
+    uint32_t const switches = stats->switches ? stats->switches : 1;
+    if (page == 0) {
+        lcd_printf_P(PSTR("Switch (us) #%lu"), stats->switches);
+        lcd_line2();
+        lcd_printf_P(PSTR("%lu/%lu/%lu"), countsToUs(stats->switches ? stats->minLatency : 0),
+                     countsToUs(stats->sumLatency / switches), countsToUs(stats->maxLatency));
+        return true;
+    }
+    result->call = 0;
+    if (page <= OS_STAT_PHASE_COUNT) {
+        lcd_writeProgString(phaseLabels + 16 * (page - 1));
+        lcd_line2();
+        lcd_writeProgString(PSTR("avg "));
+        lcd_printf_P(PSTR("%lu"), countsToUs(stats->phase[page - 1] / switches));
+        lcd_writeProgString(PSTR("us"));
+        return true;
+    }
+    ProcessID const pid = page - 1 - OS_STAT_PHASE_COUNT;
+    if (os_getProcessSlot(pid)->state == OS_PS_UNUSED) {
+        return false;
+    }
+    // Compare the process against the CPU time of all processes
+    Time total = 0;
+    for (ProcessID other = 0; other < MAX_NUMBER_OF_PROCESSES; other++) {
+        total += os_getProcessRuntime(other);
+    }
+    Time const runtime = os_getProcessRuntime(pid);
+    lcd_writeProgString(PSTR("Proc #"));
+    lcd_writeDec(pid);
+    lcd_writeProgString(PSTR(" cpu "));
+    // Dividing by a percent of the total keeps the calculation within 32 bits
+    lcd_writeDec(total ? runtime / ((total + 99) / 100) : 0);
+    lcd_writeChar('%');
+    lcd_line2();
+    lcd_writeProgString(PSTR("switches "));
+    lcd_writeDec(os_getProcessSwitches(pid));
+    return true;
+}
+
+/*!
+ *  The page to reset the scheduler statistics.
+ */
+make_pagehandler(tm_stats_reset, tm_null, 0, 0, OS_PR_ALWAYS_ALLOW, null, 0) {
+    lcd_writeProgString(PSTR("Reset statistics"));
+    os_resetSchedulerStats();
+    tm_done();
+    return true;
+}
+
 #endif
 
 #if TM_COMPILE_HEAP_SUPPORT
@@ -991,7 +1416,7 @@ static const char *getHeapName(uint8_t ram) {
 /*!
  *  The page to select which heap to inspect. Supports NULL-heaps.
  */
-make_pagehandler(tm_heap, tm_heap2, 0, 4, OS_PR_SHOW_HEAP, heapId, peekStack(0).param) {
+make_pagehandler(tm_heap, tm_heap2, 0, 5, OS_PR_SHOW_HEAP, heapId, peekStack(0).param) {
     uint16_t const ram = peekStack(0).param;
     if (ram >= os_getHeapListLength() || !os_lookupHeap(ram)) {
         return false;
@@ -1007,6 +1432,7 @@ static tm_page tm_heap_strategy;
 static tm_page tm_heap_contents;
 static tm_page tm_heap_chunks;
 static tm_page tm_heap_erase;
+static tm_page tm_heap_pools;
 
 /*!
  *  The page to select what to do with a previously selected heap.
@@ -1015,6 +1441,7 @@ static tm_page tm_heap_erase;
  *   - dump the map
  *   - browse chunks
  *   - erase everything
+ *   - show the block pools (internal heap only)
  */
 make_pagehandler(tm_heap2, tm_heap_strategy, 0, MS_MAX_COUNT, OS_PR_ALWAYS_ALLOW, null, 0) {
     Heap* const heap = os_lookupHeap(peekStack(1).param);
@@ -1045,6 +1472,16 @@ make_pagehandler(tm_heap2, tm_heap_strategy, 0, MS_MAX_COUNT, OS_PR_ALWAYS_ALLOW
             result->range = 1;
             break;
         }
+        case 4: {
+            if (heap != intHeap) {
+                return false;
+            }
+            lcd_writeProgString(PSTR("Block pools"));
+            result->call = tm_heap_pools;
+            result->param = 0;
+            result->range = OS_POOL_COUNT;
+            break;
+        }
         default:
             return false;
     }
@@ -1136,6 +1573,32 @@ make_pagehandler(tm_heap_chunks, tm_null, 0, 0, OS_PR_SHOW_HEAP, null, 0) {
     return true;
 }
 
+/*!
+ *  The page to show the usage of a block pool.
+ */
+make_pagehandler(tm_heap_pools, tm_null, 0, 0, OS_PR_SHOW_HEAP, null, 0) {
+    PoolID const id = peekStack(0).param;
+    Pool const* const pool = os_lookupPool(id);
+    if (!pool) {
+        return false;
+    }
+    lcd_writeProgString(PSTR("Pool "));
+    lcd_writeDec(id);
+    lcd_writeProgString(PSTR(" #"));
+    lcd_writeDec(pool->owner);
+    lcd_writeChar(' ');
+    lcd_writeDec(pool->count);
+    lcd_writeChar('x');
+    lcd_writeDec(pool->blockSize);
+    lcd_line2();
+    lcd_writeDec(pool->used);
+    lcd_writeChar('/');
+    lcd_writeDec(pool->peak);
+    lcd_writeProgString(PSTR(" fail "));
+    lcd_writeDec(pool->failures);
+    return true;
+}
+
 make_pagehandler(tm_heap_erase, tm_heap_erase2, 0, 1, OS_PR_ERASE_HEAP, heapId, peekStack(2).param) {
     lcd_writeProgString(PSTR("Erase map+dat of"));
     lcd_writeString(getHeapName(peekStack(2).param));
@@ -1164,6 +1627,7 @@ make_pagehandler(tm_heap_erase2, tm_null, 0, 0, OS_PR_ERASE_HEAP, heapId, peekSt
             end = os_getUseStart(heap) + os_getUseSize(heap);
         }
     }
+    os_resetFreeRuns(heap);
     tm_done();
     return true;
 }
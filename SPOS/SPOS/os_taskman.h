@@ -13,6 +13,8 @@
 
 #include <stdbool.h>
 
+#include "defines.h"
+
 //----------------------------------------------------------------------------
 // Function headers
 //----------------------------------------------------------------------------
@@ -23,4 +25,14 @@ void os_taskManMain(void);
 //! Returns true if the TaskManager is currently open
 bool os_taskManOpen(void);
 
+#if OS_TASKMAN_PROCESS
+
+//! Starts the process the TaskManager runs in
+bool os_startTaskMan(void);
+
+//! Makes the TaskManager process open the TaskManager
+bool os_requestTaskMan(void);
+
+#endif
+
 #endif
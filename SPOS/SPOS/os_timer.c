@@ -0,0 +1,220 @@
+#include "os_timer.h"
+#include "os_scheduler.h"
+#include "os_core.h"
+
+#include <avr/interrupt.h>
+
+/*! \file
+
+Software timers. The armed timers form a list that is sorted by their due
+time, so the timer 0 overflow ISR only has to look at the head of the list.
+Expired timers are only marked in the ISR. Their callbacks are called by a
+service process with interrupts enabled, which is started with the first timer.
+
+*/
+
+// The expiry mask has one bit per timer
+#if OS_TIMER_COUNT > 8
+#error "OS_TIMER_COUNT must not exceed 8"
+#endif
+
+//! The states a timer slot can be in
+typedef enum TimerState {
+    OS_TS_FREE,     //!< The slot is unused
+    OS_TS_ARMED,    //!< The timer is in the list and waits for its due time
+    OS_TS_EXPIRED   //!< A one-shot timer expired and waits for its callback
+} TimerState;
+
+//! A software timer
+typedef struct {
+    Ticks due;                  //!< Time of the next expiry
+    Ticks period;               //!< Time between two expiries
+    TimerCallback* callback;    //!< Called in the service process on expiry
+    TimerID next;               //!< Next armed timer in the list
+    TimerState state;
+    bool oneshot;               //!< Whether the timer is freed after its callback
+} Timer;
+
+//! The pool of all timers
+static Timer timers[OS_TIMER_COUNT];
+
+//! The armed timer that expires first (INVALID_TIMER if there is none)
+static TimerID timerHead = INVALID_TIMER;
+
+//! Bit i is set iff timer i expired and its callback has not been called yet
+static volatile uint8_t timerExpired = 0;
+
+//! The service process calling the callbacks (INVALID_PROCESS before it runs)
+static ProcessID timerServicePid = INVALID_PROCESS;
+
+static Program os_timerService;
+
+/*!
+ *  Inserts a timer into the list behind all timers that are due earlier or
+ *  at the same time. Must be called with interrupts disabled.
+ *
+ *  \param id The timer to insert.
+ */
+static void os_timerInsert(TimerID id) {
+    Ticks const due = timers[id].due;
+    TimerID* link = &timerHead;
+    while (*link != INVALID_TIMER && TICKS_REACHED(due, timers[*link].due)) {
+        link = &timers[*link].next;
+    }
+    timers[id].next = *link;
+    *link = id;
+}
+
+/*!
+ *  Takes a timer out of the list. Must be called with interrupts disabled.
+ *
+ *  \param id The timer to remove.
+ */
+static void os_timerRemove(TimerID id) {
+    for (TimerID* link = &timerHead; *link != INVALID_TIMER; link = &timers[*link].next) {
+        if (*link == id) {
+            *link = timers[id].next;
+            return;
+        }
+    }
+}
+
+/*!
+ *  Makes sure the service process is running. It is started again if it
+ *  was killed.
+ *
+ *  \return True iff the service process is running.
+ */
+static bool os_timerStartService(void) {
+    if (timerServicePid != INVALID_PROCESS) {
+        Process const* const service = os_getProcessSlot(timerServicePid);
+        if (service->state != OS_PS_UNUSED && service->program == os_timerService) {
+            return true;
+        }
+    }
+    timerServicePid = os_exec(os_timerService, OS_TIMER_PRIORITY);
+    return timerServicePid != INVALID_PROCESS;
+}
+
+/*!
+ *  Starts a software timer. The callback is called from the timer service
+ *  process, so it may use everything a process may use, but it delays all
+ *  other callbacks while it runs. If a periodic timer expires again before
+ *  its callback was called, the callback is only called once.
+ *  The resolution is one timer 0 overflow (~3.3 ms).
+ *
+ *  \param periodMs Time until the (first) expiry in ms, must not be 0.
+ *  \param callback The function to call on expiry.
+ *  \param oneshot If true, the timer expires once and is freed afterwards.
+ *  \return The ID of the timer or INVALID_TIMER if no timer could be started.
+ */
+TimerID os_timerStart(Time periodMs, TimerCallback* callback, bool oneshot) {
+    Ticks const period = TIME_MS_TO_TICKS(periodMs);
+    if (!period || !callback || !os_timerStartService()) {
+        return INVALID_TIMER;
+    }
+    uint8_t const sreg = SREG;
+    cli();
+    TimerID id = 0;
+    while (id < OS_TIMER_COUNT && timers[id].state != OS_TS_FREE) {
+        id++;
+    }
+    if (id == OS_TIMER_COUNT) {
+        SREG = sreg;
+        return INVALID_TIMER;
+    }
+    timers[id] = (Timer){
+        .due = os_ticks() + period,
+        .period = period,
+        .callback = callback,
+        .state = OS_TS_ARMED,
+        .oneshot = oneshot
+    };
+    os_timerInsert(id);
+    SREG = sreg;
+    return id;
+}
+
+/*!
+ *  Stops a timer and frees its slot. A callback that is running right now
+ *  is not interrupted.
+ *
+ *  \param id The timer to stop.
+ *  \return True iff the timer was running.
+ */
+bool os_timerStop(TimerID id) {
+    if (id >= OS_TIMER_COUNT) {
+        return false;
+    }
+    uint8_t const sreg = SREG;
+    cli();
+    bool const running = timers[id].state != OS_TS_FREE;
+    if (timers[id].state == OS_TS_ARMED) {
+        os_timerRemove(id);
+    }
+    timers[id].state = OS_TS_FREE;
+    timerExpired &= ~(1 << id);
+    SREG = sreg;
+    return running;
+}
+
+/*!
+ *  Takes every expired timer from the head of the list, marks it and wakes
+ *  up the service process. Periodic timers are due again one period after
+ *  their last due time, so they do not drift.
+ *  Is called with interrupts disabled from the timer 0 overflow ISR.
+ */
+void os_timerTick(void) {
+    if (timerHead == INVALID_TIMER) {
+        return;
+    }
+    Ticks const now = os_ticks();
+    if (!TICKS_REACHED(now, timers[timerHead].due)) {
+        return;
+    }
+    do {
+        TimerID const id = timerHead;
+        timerHead = timers[id].next;
+        timerExpired |= 1 << id;
+        if (timers[id].oneshot) {
+            timers[id].state = OS_TS_EXPIRED;
+        } else {
+            timers[id].due += timers[id].period;
+            os_timerInsert(id);
+        }
+    } while (timerHead != INVALID_TIMER && TICKS_REACHED(now, timers[timerHead].due));
+    os_unblock(timerServicePid);
+}
+
+/*!
+ *  The service process. It blocks until timers expired and then calls their
+ *  callbacks with interrupts enabled.
+ */
+static void os_timerService(void) {
+    for (;;) {
+        cli();
+        while (!timerExpired) {
+            os_block();
+        }
+        uint8_t const expired = timerExpired;
+        timerExpired = 0;
+        sei();
+        for (TimerID id = 0; id < OS_TIMER_COUNT; id++) {
+            if (!(expired & (1 << id))) {
+                continue;
+            }
+            cli();
+            // The timer may have been stopped in the meantime
+            TimerCallback* const callback = timers[id].state != OS_TS_FREE ? timers[id].callback : NULL;
+            sei();
+            if (callback) {
+                callback();
+            }
+            cli();
+            if (timers[id].state == OS_TS_EXPIRED) {
+                timers[id].state = OS_TS_FREE;
+            }
+            sei();
+        }
+    }
+}
@@ -0,0 +1,47 @@
+/*! \file
+ *  \brief Software timers of the OS.
+ *
+ *  Periodic and one-shot callbacks that share a single service process
+ *  instead of occupying a process slot each.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_TIMER_H
+#define _OS_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "defines.h"
+#include "util.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! The type for the ID of a software timer
+typedef uint8_t TimerID;
+
+//! This is the type of a timer callback (not the pointer to one!)
+typedef void TimerCallback(void);
+
+//! ID that is returned if no timer could be started
+#define INVALID_TIMER               255
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+//! Starts a timer that calls the callback after (and every) periodMs
+TimerID os_timerStart(Time periodMs, TimerCallback* callback, bool oneshot);
+
+//! Stops a timer, so its callback is not called anymore
+bool os_timerStop(TimerID id);
+
+//! Checks for expired timers, called on every timer 0 overflow
+void os_timerTick(void);
+
+#endif
@@ -0,0 +1,110 @@
+#include "os_trace.h"
+#include "util.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/*! \file
+
+The event trace. Events are written into a ring buffer of bytes with
+interrupts disabled, as they come from processes and ISRs alike. The data
+register empty interrupt of USART0 sends the buffer byte by byte right from
+where it is stored and turns itself off once the buffer is empty.
+
+*/
+
+#if OS_TRACE
+
+#if MAX_NUMBER_OF_PROCESSES > 16
+#error "The trace has room for 16 processes only"
+#endif
+
+#if OS_TRACE_BUFFER_SIZE & (OS_TRACE_BUFFER_SIZE - 1) || OS_TRACE_BUFFER_SIZE > 128 || OS_TRACE_BUFFER_SIZE < 8
+#error "OS_TRACE_BUFFER_SIZE must be a power of two from 8 to 128"
+#endif
+
+//! Size of one event in bytes
+#define TRACE_RECORD_SIZE 4
+
+//! Value for the baud rate register of USART0
+#define TRACE_UBRR (F_CPU / 16 / OS_TRACE_BAUD - 1)
+
+//! Events that wait to be sent
+static uint8_t traceBuffer[OS_TRACE_BUFFER_SIZE];
+
+//! Number of bytes recorded so far, wraps around at 256
+static uint8_t traceHead = 0;
+
+//! Number of bytes sent so far, wraps around at 256
+static volatile uint8_t traceTail = 0;
+
+//! Number of events that were dropped since the last one was recorded
+static uint32_t traceLost = 0;
+
+/*!
+ *  Sets up USART0 for sending only, with 8 data bits, no parity and one
+ *  stop bit at OS_TRACE_BAUD.
+ */
+void os_initTrace(void) {
+    UBRR0 = TRACE_UBRR;
+    UCSR0A = 0;
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+    UCSR0B = 1 << TXEN0;
+}
+
+/*!
+ *  Appends one event to the buffer. Must be called with interrupts disabled
+ *  and enough space for it.
+ *
+ *  \param head The byte to start the event with.
+ *  \param value The 21 bits that follow.
+ */
+static void os_traceStore(uint8_t head, uint32_t value) {
+    uint8_t const mask = OS_TRACE_BUFFER_SIZE - 1;
+    traceBuffer[traceHead++ & mask] = head;
+    traceBuffer[traceHead++ & mask] = value & 0x7F;
+    traceBuffer[traceHead++ & mask] = (value >> 7) & 0x7F;
+    traceBuffer[traceHead++ & mask] = (value >> 14) & 0x7F;
+}
+
+/*!
+ *  Records an event together with the current time. If the buffer is full,
+ *  the event is dropped and counted. The number of dropped events is
+ *  recorded as an event of its own as soon as there is space again.
+ *  May be called from an ISR.
+ *
+ *  \param event What happened.
+ *  \param pid The process it happened to.
+ */
+void os_trace(TraceEvent event, ProcessID pid) {
+    uint8_t const sreg = SREG;
+    cli();
+    uint8_t const space = OS_TRACE_BUFFER_SIZE - (uint8_t)(traceHead - traceTail);
+    if (space < (traceLost ? 2 : 1) * TRACE_RECORD_SIZE) {
+        traceLost++;
+        SREG = sreg;
+        return;
+    }
+    if (traceLost) {
+        os_traceStore(0x80 | (OS_TE_LOST << 4) | 0x0F, traceLost < 0x1FFFFF ? traceLost : 0x1FFFFF);
+        traceLost = 0;
+    }
+    os_traceStore(0x80 | (event << 4) | (pid & 0x0F), os_ticks());
+    UCSR0B |= 1 << UDRIE0;
+    SREG = sreg;
+}
+
+/*!
+ *  Sends the next byte of the buffer, or stops sending once it is empty.
+ */
+ISR(USART0_UDRE_vect) {
+    uint8_t const tail = traceTail;
+    if (tail == traceHead) {
+        UCSR0B &= ~(1 << UDRIE0);
+        return;
+    }
+    UDR0 = traceBuffer[tail & (OS_TRACE_BUFFER_SIZE - 1)];
+    traceTail = tail + 1;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*! \file
+ *  \brief Binary event trace of the OS.
+ *
+ *  Records scheduling events in a ring buffer that is sent over USART0 in
+ *  the background, to be decoded by SPOS/tools/trace_decode.py.
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#ifndef _OS_TRACE_H
+#define _OS_TRACE_H
+
+#include <stdint.h>
+
+#include "defines.h"
+#include "os_process.h"
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+/*!
+ *  The events that are traced. Every event is sent as four bytes: the first
+ *  one has bit 7 set and holds the event in bits 6-4 and the process in bits
+ *  3-0. The other three carry the lower 21 bits of os_ticks, 7 bits each
+ *  starting with the least significant ones, and have bit 7 cleared.
+ */
+typedef enum TraceEvent {
+    OS_TE_SWITCH_OUT,   //!< The scheduler took the processor from the process
+    OS_TE_SWITCH_IN,    //!< The scheduler handed the processor to the process
+    OS_TE_EXEC,         //!< The process was started
+    OS_TE_BLOCK,        //!< The process blocked
+    OS_TE_WAKE,         //!< The process was unblocked
+    OS_TE_ENTER_CS,     //!< The process entered a critical section
+    OS_TE_LEAVE_CS,     //!< The process left a critical section
+    OS_TE_LOST          //!< Events were dropped, the time field holds their number
+} TraceEvent;
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
+
+#if OS_TRACE
+
+//! Sets up USART0 for sending the trace
+void os_initTrace(void);
+
+//! Records an event of a process
+void os_trace(TraceEvent event, ProcessID pid);
+
+#else
+
+#define os_initTrace()
+#define os_trace(EVENT, PID)
+
+#endif
+
+#endif
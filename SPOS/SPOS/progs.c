@@ -11,11 +11,15 @@
 #include "util.h"
 #include "os_core.h"
 #include "os_scheduler.h"
+#include "os_input.h"
 
 #if VERSUCH < 2
 #error "Please fix the VERSUCH-define"
 #endif
 
+// The benchmark in bench.c replaces the test
+#if !OS_BENCHMARK
+
 //---- Adjust here what to test -------------------
 #define PHASE_1 1
 #define PHASE_2 1
@@ -87,10 +91,19 @@ static volatile bool flag;
 // Acquire criticalSectionCount
 extern uint8_t criticalSectionCount;
 
+#if OS_INPUT_EVENTS
+// Check for a press of the Enter button, the OS owns the pin change ISR
+static void enterChanged(void) {
+	if (os_getInput() & 0b0001) {
+		flag = true;
+	}
+}
+#else
 // Check for a pin change on Enter button
 ISR(PCINT2_vect) {
 	flag = true;
 }
+#endif
 
 
 void dummy_program(void) {
@@ -111,8 +124,12 @@ void main_program(void) {
 	delayMs(DEFAULT_OUTPUT_DELAY * 10);
 
 	// Setup Pin Change interrupt for Enter button
+	#if OS_INPUT_EVENTS
+	os_setPinChangeHook(enterChanged);
+	#else
 	PCICR  = (1 << PCIE2);
 	PCMSK2 = (1 << PCINT16);
+	#endif
 
 	os_enterCriticalSection();
 
@@ -153,6 +170,9 @@ void main_program(void) {
 	// Check if button was either not pressed or pin change interrupt
 	// was blocked by critical section
 	TEST_ASSERT(flag, "No button press detected");
+	#if OS_INPUT_EVENTS
+	os_setPinChangeHook(NULL);
+	#endif
 
 	lcd_writeProgString(PSTR("Phase 1 complete"));
 	delayMs(DEFAULT_OUTPUT_DELAY * 10);
@@ -284,4 +304,6 @@ void main_program(void) {
 		TEST_PASSED;
 		HALT;
 	}
-}
\ No newline at end of file
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include "defines.h"
 #include "os_core.h"
 #include "os_input.h"
+#include "os_timer.h"
 #include "lcd.h"
 
 #include <avr/io.h>
@@ -19,106 +20,177 @@
  */
 static Time os_systemTime_overflows = 0;
 
+/*!
+ * Milliseconds since the system time was reset, counted along with the overflows so that reading
+ * the time in ms needs no division.
+ */
+static Time os_systemTime_ms = 0;
+
+/*!
+ * Remainder of the time in ms, in units of 1/F_CPU ms. It is always smaller than F_CPU.
+ */
+static uint32_t os_systemTime_msFraction = 0;
+
+//! Length of one timer 0 overflow in units of 1/F_CPU ms
+#define MS_FRACTION_PER_OVERFLOW (256ul * TC0_PRESCALER * 1000ul)
+
+//! Length of one timer 0 count in units of 1/F_CPU ms
+#define MS_FRACTION_PER_TICK (TC0_PRESCALER * 1000ul)
+
+/*!
+ * Accounts one timer 0 overflow. At most a few milliseconds are carried, so a loop of
+ * subtractions is cheaper than a division.
+ */
+static void os_systemTime_countOverflow(void) {
+    os_systemTime_overflows++;
+    os_systemTime_msFraction += MS_FRACTION_PER_OVERFLOW;
+    while (os_systemTime_msFraction >= F_CPU) {
+        os_systemTime_msFraction -= F_CPU;
+        os_systemTime_ms++;
+    }
+}
+
 /*!
  * ISR that counts the number of occurred Timer 0 overflows for the os_systemTime_[coarse|precise] functions.
+ * It also drives the debouncing of the buttons and the software timers.
  */
 ISR(TIMER0_OVF_vect) {
-    os_systemTime_overflows++;
+    os_systemTime_countOverflow();
+#if OS_INPUT_EVENTS
+    os_inputTick();
+#endif
+    os_timerTick();
 }
 
 /*!
  * Function to reset os_systemTime_overflows to 0, effectively resetting the internal system time
  */
 void os_systemTime_reset(void){
+    uint8_t const sreg = SREG;
+    cli();
     os_systemTime_overflows = 0;
+    os_systemTime_ms = 0;
+    os_systemTime_msFraction = 0;
+    SREG = sreg;
+}
+
+/*!
+ * In case interrupts are off and the overflow flag is set, the overflow interrupt is simulated.
+ * The flag signalizes that an overflow occurred. It would have been handled by the ISR immediately,
+ * but since the interrupts are off, the controller waits until they come back on. Until that point
+ * yet another overflow could occur, which we would then be unable to detect.
+ * Has to be called with interrupts disabled.
+ *
+ * \param sreg The status register of the caller, before it disabled interrupts.
+ * \return True iff an overflow is pending and will be counted by the ISR later.
+ */
+static bool os_systemTime_catchUp(uint8_t sreg) {
+    if (!(TIFR0 & (1 << TOV0))) {
+        return false;
+    }
+    if (sreg & (1 << SREG_I)) {
+        return true;
+    }
+    TIFR0 = 1 << TOV0;
+    os_systemTime_countOverflow();
+    return false;
+}
+
+/*!
+ * Returns the raw system time in timer 0 counts (TC0_PRESCALER CPU cycles each). The overflow
+ * counter and TCNT0 are read atomically, so the result never jumps back at an overflow.
+ * The counts wrap around after 2^32 counts (about 15 h at 20 MHz); compute differences of
+ * two values to stay wrap-safe, e.g. with TICKS_REACHED.
+ *
+ * \return The system time in timer 0 counts.
+ */
+Ticks os_ticks(void) {
+    uint8_t const sreg = SREG;
+    cli();
+    uint8_t count = TCNT0;
+    bool const overflowed = TIFR0 & (1 << TOV0);
+    if (overflowed) {
+        // The counter may have wrapped after it was read, the new count belongs to the overflow
+        count = TCNT0;
+    }
+    // The flag is still set, so this counts exactly the overflow that was seen
+    bool const pending = overflowed && os_systemTime_catchUp(sreg);
+    Ticks const ticks = ((os_systemTime_overflows + pending) << 8) | count;
+    SREG = sreg;
+    return ticks;
 }
 
 /*!
 * Function that returns the current systemtime in ms based on the interrupt counts alone
-* (Difference ROUNDED after ~80s by 1s to os_systemTime_precise)
 *
-* \return The converted system time in ms
+* \return The system time in ms, with a resolution of one timer 0 overflow (~3.3 ms)
 */
 Time os_systemTime_coarse(void) {
-    /*! calculation performed:
-     *   os_systemTime_overflows*1000                /(F_CPU/TC0_PRESCALER/256)
-     *   timercounts            |   mult to get ms   | to get from freq to time 
-     */
-    return os_systemTime_overflows * 1000 / (F_CPU/TC0_PRESCALER/256);
-} 
+    uint8_t const sreg = SREG;
+    cli();
+    os_systemTime_catchUp(sreg);
+    Time const ms = os_systemTime_ms;
+    SREG = sreg;
+    return ms;
+}
 
 /*!
  * Function augments os_systemTime_overflows to increase precision to approx 13 us (presc/f_cpu = 256/20MHz)
  *
  * \return os_systemTime_overflows scaled by cpu speed , timer prescaler as well as register size
  */
-static Time os_systemTime_augment(void) {
-    /*! in case Interrupts are off and the overflow flag is activated we simulate the overflow interrupt.
-     *  The flag signalizes, that an overflow occurred. This would have been handled by the ISR immediately
-     *  but since the interrupts are off, the controller will wait until they come back on. However,
-     *  until that point yet another overflow could occur, which we would then be unable to detect.
-     */
-
-    if ((!(SREG & (1<<7))) && (TIFR0 & (1<<TOV0))) {
-        TIFR0 |= (1<<TOV0);
-        os_systemTime_overflows++;
-    }
-
-    /*! here comes the actual job of this routine. We take the coarse system time which has a 
-     *   resolution of 3.3 ms and augment it with the current TCNT0 counter register, yielding
-     *   a resolution of ~ 13 us.
-     */
-    return ((os_systemTime_overflows<<8) | TCNT0);
+Time os_systemTime_augment(void) {
+    return os_ticks();
 }
 
 /*!
  * Function that returns the current systemtime in ms augmented by additional timer registers,
  * leading to higher accuracy at expense of performance. If not needed better use os_systemTime_coarse()
- * (Difference ROUNDED after ~80s by 1s to os_systemTime_coarse)
- * 
+ *
  * \return The converted system time in ms augmented by TCNT0 counter register
  */
 Time os_systemTime_precise(void) {
-    /*! calculation performed:
-     *  os_systemTime_augment()     *1000              /(F_CPU/TC0_PRESCALER/256)   / 256
-     *  timercounts + TCNT0 counter | mult to get ms   | to get from freq to time    | to account for shift by os_systemTime_augment()
-     *  this can be simplified to :
-     */
-    return (os_systemTime_augment() / (F_CPU/(TC0_PRESCALER*1000ul)));
+    uint8_t const sreg = SREG;
+    cli();
+    uint8_t count = TCNT0;
+    bool const overflowed = TIFR0 & (1 << TOV0);
+    if (overflowed) {
+        // Same as in os_ticks, the new count belongs to the overflow
+        count = TCNT0;
+    }
+    bool const pending = overflowed && os_systemTime_catchUp(sreg);
+    Time ms = os_systemTime_ms;
+    uint32_t fraction = os_systemTime_msFraction;
+    if (pending) {
+        fraction += MS_FRACTION_PER_OVERFLOW;
+    }
+    SREG = sreg;
+    // Less than two overflows are left, so again a few subtractions replace the division
+    fraction += count * MS_FRACTION_PER_TICK;
+    while (fraction >= F_CPU) {
+        fraction -= F_CPU;
+        ms++;
+    }
+    return ms;
 }
 
 
 /*!
  *  Function that may be used to wait for specific time intervals.
- *  Therefore, we calculate the relative time to wait. This value is added to the current system time
- *  in order to get the destination time. Then, we wait until a temporary variable reaches this value.
+ *  The time to wait is converted into timer 0 counts once. Then we wait until that many counts
+ *  have passed, which is wrap-safe as only the difference of two counts is looked at.
  *
  *  \param ms  The time to be waited in milliseconds (max. 2^32 = 4294967296 ms ~= 7 weeks)
  */
 void delayMs(Time ms) {
-    Time startTime = os_systemTime_precise();
-    Time destinationTime = startTime + ms;
-    Time now;
-
-    /*! We have to distinguish two cases:
-     * 1.) If the startTime is smaller than the destinationTime, we can wait until the current time (= now)
-     * is bigger than startTime but smaller than the destinationTime.
-     * Keep waiting if the value of now is anywhere in the sections marked with +
-     *    0 |----------------S+++++++++++++++D-------| max time
-
-     * 2.) If we detect an overflow (startTime > destinationTime) then we have to wait for now reaching
-     * maxtime (the overflow) and afterwards now reaching destinationTime
-     * Keep waiting if now is anywhere in the sections marked with +
-     *    0 |++++++++++++++++D---------------S+++++++| max time
-     */
-    if (startTime <= destinationTime) {
-        do{
-            now = os_systemTime_precise();
-        } while ((startTime <= now) && (now < destinationTime));
-    } else {
-        do{
-            now = os_systemTime_precise();
-        } while ((now < destinationTime) || (startTime <= now));
+    // Longer waits are split, so the counts cannot wrap within one of them
+    while (ms > TIME_H_TO_MS(1)) {
+        delayMs(TIME_H_TO_MS(1));
+        ms -= TIME_H_TO_MS(1);
+    }
+    Ticks const startTime = os_ticks();
+    Ticks const duration = TIME_MS_TO_TICKS(ms);
+    while (os_ticks() - startTime < duration) {
     }
 }
 
@@ -18,6 +18,9 @@
 
 typedef uint32_t Time;
 
+//! Raw system time in timer 0 counts, wraps around after 2^32 counts
+typedef uint32_t Ticks;
+
 #define TC0_PRESCALER 256
 
 //----------------------------------------------------------------------------
@@ -33,6 +36,12 @@ Time os_systemTime_coarse(void);
 //! Precise system time in ms
 Time os_systemTime_precise(void);
 
+//! Raw system time in timer 0 counts, read atomically
+Ticks os_ticks(void);
+
+//! System time in timer 0 counts (TC0_PRESCALER CPU cycles each)
+Time os_systemTime_augment(void);
+
 //! Waits for some milliseconds
 void delayMs(Time ms);
 
@@ -60,6 +69,25 @@ bool assertPstr(bool exp, char const* errormsg);
 #define TIME_M_TO_MS(m)     (TIME_S_TO_MS(m *  60ul))
 #define TIME_H_TO_MS(h)     (TIME_M_TO_MS(h *  60ul))
 
+//tick related macros, all factors are folded at compile time
+#define TICKS_PER_S         (F_CPU / TC0_PRESCALER)
+#define TICKS_PER_MS_Q8     ((Ticks)((TICKS_PER_S * 256ull) / 1000ul))         // fixed point, 8 fractional bits
+#define TICKS_PER_US_Q16    ((Ticks)((TICKS_PER_S * 65536ull) / 1000000ul))    // fixed point, 16 fractional bits
+#define MS_PER_TICK_Q22     ((Ticks)(((1000ull << 22) + TICKS_PER_S / 2) / TICKS_PER_S))    // fixed point, 22 fractional bits
+#define US_PER_TICK_Q12     ((Ticks)(((1000000ull << 12) + TICKS_PER_S / 2) / TICKS_PER_S))    // fixed point, 12 fractional bits
+#define US_PER_TICK_Q16     ((Ticks)(((1000000ull << 16) + TICKS_PER_S / 2) / TICKS_PER_S))    // fixed point, 16 fractional bits
+
+// The time is split into a high and a low part, so both products fit into 32 bits
+#define TIME_MS_TO_TICKS(ms) ((Ticks)(((Ticks)(ms) >> 8) * TICKS_PER_MS_Q8 + ((((Ticks)(ms) & 0xFF) * TICKS_PER_MS_Q8) >> 8)))
+#define TIME_US_TO_TICKS(us) ((Ticks)(((Ticks)(us) >> 16) * TICKS_PER_US_Q16 + ((((Ticks)(us) & 0xFFFF) * TICKS_PER_US_Q16) >> 16)))
+
+// Same split for the other direction, sized for 20 MHz; the factors are rounded, so a result may be one unit short
+#define TIME_TICKS_TO_MS(t) ((Time)(((((Ticks)(t) >> 16) * MS_PER_TICK_Q22) >> 6) + ((((Ticks)(t) & 0xFFFF) * MS_PER_TICK_Q22) >> 22)))
+#define TIME_TICKS_TO_US(t) ((Time)(((Ticks)(t) >> 12) * US_PER_TICK_Q12 + ((((Ticks)(t) & 0xFFF) * US_PER_TICK_Q16) >> 16)))
+
+//! Wrap-safe check whether the tick count now has reached deadline (at most 2^31 counts apart)
+#define TICKS_REACHED(now, deadline) ((int32_t)((Ticks)(now) - (Ticks)(deadline)) >= 0)
+
 //----------------------------------------------------------------------------
 // Assembler macros
 //----------------------------------------------------------------------------
@@ -161,6 +189,74 @@ bool assertPstr(bool exp, char const* errormsg);
   );
 
 
+/*!
+ * \brief Saves the context of a voluntary switch on the stack
+ *
+ * Only SREG and the registers that a called function has to preserve
+ * (r2-r17, r28, r29) are saved. This may only be used at the beginning of
+ * a function that is entered by a call, since the ABI already allows the
+ * callee to clobber all other registers and guarantees r1 to be zero.
+ * Interrupts are disabled afterwards.
+ */
+#define saveLightContext() \
+  __asm__ volatile( \
+    "in    r0, __SREG__                  \n\t" \
+    "cli                                 \n\t" \
+    "push  r0                            \n\t" \
+    "push  r2                            \n\t" \
+    "push  r3                            \n\t" \
+    "push  r4                            \n\t" \
+    "push  r5                            \n\t" \
+    "push  r6                            \n\t" \
+    "push  r7                            \n\t" \
+    "push  r8                            \n\t" \
+    "push  r9                            \n\t" \
+    "push  r10                           \n\t" \
+    "push  r11                           \n\t" \
+    "push  r12                           \n\t" \
+    "push  r13                           \n\t" \
+    "push  r14                           \n\t" \
+    "push  r15                           \n\t" \
+    "push  r16                           \n\t" \
+    "push  r17                           \n\t" \
+    "push  r28                           \n\t" \
+    "push  r29                           \n\t" \
+  );
+
+
+/*!
+ * \brief Restores a context that was saved by saveLightContext
+ *
+ * The callee-saved registers and SREG are popped from the stack and the
+ * function that saved the context returns to its caller.
+ */
+#define restoreLightContext() \
+  __asm__ volatile( \
+    "pop  r29                            \n\t" \
+    "pop  r28                            \n\t" \
+    "pop  r17                            \n\t" \
+    "pop  r16                            \n\t" \
+    "pop  r15                            \n\t" \
+    "pop  r14                            \n\t" \
+    "pop  r13                            \n\t" \
+    "pop  r12                            \n\t" \
+    "pop  r11                            \n\t" \
+    "pop  r10                            \n\t" \
+    "pop  r9                             \n\t" \
+    "pop  r8                             \n\t" \
+    "pop  r7                             \n\t" \
+    "pop  r6                             \n\t" \
+    "pop  r5                             \n\t" \
+    "pop  r4                             \n\t" \
+    "pop  r3                             \n\t" \
+    "pop  r2                             \n\t" \
+    "pop  r0                             \n\t" \
+    "clr  r1                             \n\t" \
+    "out  __SREG__, r0                   \n\t" \
+    "ret                                 \n\t" \
+  );
+
+
 #define HALT do {} while(1)
 
 // Used in testtasks
@@ -0,0 +1,16 @@
+/*! \file
+ *  \brief Host replacement for the interrupt control of avr-libc.
+ *
+ *  The simulator has no interrupts, so enabling and disabling them only
+ *  changes the status register that the inline helpers of the OS look at.
+ */
+
+#ifndef _SIM_AVR_INTERRUPT_H
+#define _SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define cli()   (SREG &= ~(1 << SREG_I))
+#define sei()   (SREG |= 1 << SREG_I)
+
+#endif
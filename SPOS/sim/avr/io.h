@@ -0,0 +1,22 @@
+/*! \file
+ *  \brief Host replacement for the register definitions of avr-libc.
+ *
+ *  Only the memory layout of the ATmega644 and the status register are
+ *  needed to compile the scheduling strategies on the host.
+ */
+
+#ifndef _SIM_AVR_IO_H
+#define _SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#define RAMSTART    0x100
+#define RAMEND      0x10FF
+#define E2END       0x7FF
+#define FLASHEND    0xFFFF
+
+//! The status register, only the interrupt flag is meaningful
+extern volatile uint8_t SREG;
+#define SREG_I      7
+
+#endif
@@ -0,0 +1,18 @@
+/*! \file
+ *  \brief Host replacement for the program memory access of avr-libc.
+ *
+ *  The host has a single address space, so program memory is read like
+ *  any other memory.
+ */
+
+#ifndef _SIM_AVR_PGMSPACE_H
+#define _SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define pgm_read_byte(a)    (*(uint8_t const*)(a))
+#define pgm_read_word(a)    (*(uint16_t const*)(a))
+
+#endif
@@ -0,0 +1,460 @@
+/*! \file
+ *  \brief Host simulator for the scheduling strategies.
+ *
+ *  Compiles os_scheduling_strategies.c for the host and replays synthetic
+ *  workloads against every strategy. The scheduler functions the strategies
+ *  call are provided here instead of by os_scheduler.c.
+ *
+ *  For every workload and strategy it reports
+ *   - the cost of a decision in ns and CPU cycles,
+ *   - how well the CPU time follows the priorities (Jain's index of the CPU
+ *     time per ready tick and priority unit, 1 is perfectly proportional),
+ *   - the distribution of the ticks a ready process waits until it runs,
+ *   - the processes that were ready but never ran.
+ *
+ *  Built and run with make sim, usage: sched_sim [-t ticks] [-s seed] [-v]
+ *
+ *  \author   Lehrstuhl Informatik 11 - RWTH Aachen
+ *  \date     2013
+ *  \version  2.0
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "os_scheduler.h"
+#include "os_scheduling_strategies.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SIM_HAS_TSC 1
+#else
+#define SIM_HAS_TSC 0
+#endif
+
+//----------------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------------
+
+//! Behaviour of a simulated process
+typedef struct {
+    Priority priority;
+    uint16_t burstMin;      //!< Shortest burst of CPU ticks before it blocks
+    uint16_t burstMax;      //!< Longest burst, 0 for a process that never blocks
+    uint16_t blockMin;      //!< Shortest time it stays blocked
+    uint16_t blockMax;      //!< Longest time it stays blocked
+} ProcessModel;
+
+//! A synthetic workload, fills the models of processes 1..count
+typedef struct {
+    char const* name;
+    void (*setup)(ProcessModel models[], uint8_t count);
+} Workload;
+
+//! Upper bound of the wait time histogram, longer waits share the last bucket
+#define WAIT_BUCKETS 4096
+
+//! What is recorded about every process during a run
+typedef struct {
+    uint32_t run;           //!< Ticks it was selected
+    uint32_t ready;         //!< Ticks it was ready (or running)
+    uint32_t remaining;     //!< Ticks left in its burst or its blocked time
+    uint32_t readySince;    //!< Tick at which it started waiting
+    bool waiting;           //!< Ready but not running
+} ProcessRecord;
+
+//! The results of one run
+typedef struct {
+    double nsPerDecision;
+    double cyclesPerDecision;
+    uint64_t maxCycles;
+    double fairness;
+    uint32_t waitP50;
+    uint32_t waitP90;
+    uint32_t waitP99;
+    uint32_t waitMax;
+    uint8_t starved;
+} RunResult;
+
+//----------------------------------------------------------------------------
+// Scheduler stubs
+//----------------------------------------------------------------------------
+
+//! The status register of the inline helpers in os_scheduler.h
+volatile uint8_t SREG;
+
+//! The simulated processes, as the scheduler keeps them
+static Process processes[MAX_NUMBER_OF_PROCESSES];
+
+//! The simulated ready set
+static ProcessSet readySet;
+
+//! The simulated current process
+static ProcessID currentProc;
+
+//! Timer 0 counts per tick of the simulated scheduler
+#define SIM_TICK_COUNTS (DEFAULT_TICK_PERIOD * 1024ul / TC0_PRESCALER)
+
+//! The simulated system time in timer 0 counts
+static Ticks simTicks;
+
+Process* os_getProcessSlot(ProcessID pid) {
+    return &processes[pid];
+}
+
+ProcessSet os_getReadySet(void) {
+    return readySet;
+}
+
+ProcessID os_getCurrentProc(void) {
+    return currentProc;
+}
+
+Ticks os_ticks(void) {
+    return simTicks;
+}
+
+// The simulated processes never yield or sleep themselves
+void os_yield(void) {
+}
+
+void os_sleep(Time ms) {
+}
+
+//----------------------------------------------------------------------------
+// Strategies
+//----------------------------------------------------------------------------
+
+//! Names of the strategies in the order of SchedulingStrategy
+static char const* const strategyNames[OS_SS_COUNT] = {
+    [OS_SS_EVEN]              = "Even",
+    [OS_SS_RANDOM]            = "Random",
+    [OS_SS_RUN_TO_COMPLETION] = "RunToCompletion",
+    [OS_SS_ROUND_ROBIN]       = "RoundRobin",
+    [OS_SS_INACTIVE_AGING]    = "InactiveAging",
+    [OS_SS_EDF]               = "EDF",
+};
+
+//! Implementations of the strategies in the order of SchedulingStrategy
+static SchedulingStrategyFunction* const strategyFunctions[OS_SS_COUNT] = {
+    [OS_SS_EVEN]              = os_Scheduler_Even,
+    [OS_SS_RANDOM]            = os_Scheduler_Random,
+    [OS_SS_RUN_TO_COMPLETION] = os_Scheduler_RunToCompletion,
+    [OS_SS_ROUND_ROBIN]       = os_Scheduler_RoundRobin,
+    [OS_SS_INACTIVE_AGING]    = os_Scheduler_InactiveAging,
+    [OS_SS_EDF]               = os_Scheduler_EDF,
+};
+
+//----------------------------------------------------------------------------
+// Workloads
+//----------------------------------------------------------------------------
+
+//! State of the generator for the workloads, independent of rand() of the strategies
+static uint32_t simRandomState;
+
+//! Returns a pseudo random number (xorshift32)
+static uint32_t simRandom(void) {
+    simRandomState ^= simRandomState << 13;
+    simRandomState ^= simRandomState >> 17;
+    simRandomState ^= simRandomState << 5;
+    return simRandomState;
+}
+
+//! Returns a pseudo random number in [min, max]
+static uint32_t simRandomRange(uint32_t min, uint32_t max) {
+    return min + simRandom() % (max - min + 1);
+}
+
+//! CPU bound processes of the same priority
+static void setupEqual(ProcessModel models[], uint8_t count) {
+    for (uint8_t i = 1; i <= count; i++) {
+        models[i] = (ProcessModel){ .priority = 10 };
+    }
+}
+
+//! CPU bound processes with priorities spread over the whole range
+static void setupMixed(ProcessModel models[], uint8_t count) {
+    for (uint8_t i = 1; i <= count; i++) {
+        models[i] = (ProcessModel){ .priority = (Priority)(1 + (254 * (i - 1)) / (count > 1 ? count - 1 : 1)) };
+    }
+}
+
+//! Processes of random priorities that block often and briefly
+static void setupChurn(ProcessModel models[], uint8_t count) {
+    for (uint8_t i = 1; i <= count; i++) {
+        models[i] = (ProcessModel){
+            .priority = (Priority)simRandomRange(1, 255),
+            .burstMin = 1, .burstMax = 8,
+            .blockMin = 1, .blockMax = 20
+        };
+    }
+}
+
+//! Two low priority CPU bound processes among short high priority bursts
+static void setupInteractive(ProcessModel models[], uint8_t count) {
+    for (uint8_t i = 1; i <= count; i++) {
+        if (i <= 2) {
+            models[i] = (ProcessModel){ .priority = 5 };
+        } else {
+            models[i] = (ProcessModel){
+                .priority = 200,
+                .burstMin = 1, .burstMax = 2,
+                .blockMin = 10, .blockMax = 50
+            };
+        }
+    }
+}
+
+//! All workloads that are replayed
+static Workload const workloads[] = {
+    { "equal",       setupEqual },
+    { "mixed",       setupMixed },
+    { "churn",       setupChurn },
+    { "interactive", setupInteractive },
+};
+
+//----------------------------------------------------------------------------
+// Measurement
+//----------------------------------------------------------------------------
+
+//! Returns the monotonic time in ns
+static uint64_t simNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//! Returns a cycle count (ns where there is no time stamp counter)
+static inline uint64_t simCycles(void) {
+#if SIM_HAS_TSC
+    return __rdtsc();
+#else
+    return simNow();
+#endif
+}
+
+//! Time stamp counter cycles per ns
+static double cyclesPerNs = 1.0;
+
+//! Cycles that reading the counter twice costs by itself
+static uint64_t cycleOverhead = 0;
+
+//! Measures the rate and the read overhead of the cycle counter
+static void simCalibrate(void) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t const start = simCycles();
+        uint64_t const end = simCycles();
+        if (end - start < best) {
+            best = end - start;
+        }
+    }
+    cycleOverhead = best;
+#if SIM_HAS_TSC
+    uint64_t const startNs = simNow();
+    uint64_t const startCycles = simCycles();
+    while (simNow() - startNs < 50000000ull) {
+    }
+    cyclesPerNs = (double)(simCycles() - startCycles) / (double)(simNow() - startNs);
+#endif
+}
+
+//! Returns the smallest wait such that the given share of all waits is not longer
+static uint32_t simPercentile(uint32_t const histogram[], uint64_t total, double share) {
+    uint64_t const target = (uint64_t)ceil(share * (double)total);
+    uint64_t sum = 0;
+    for (uint32_t wait = 0; wait < WAIT_BUCKETS; wait++) {
+        sum += histogram[wait];
+        if (sum >= target) {
+            return wait;
+        }
+    }
+    return WAIT_BUCKETS - 1;
+}
+
+/*!
+ *  Replays a workload with one strategy. Every tick, blocked processes whose
+ *  time is up become ready, the strategy selects the next process and the
+ *  selected process uses up one tick of its burst. A process whose burst
+ *  is used up blocks.
+ *
+ *  \param models The behaviour of processes 1..count.
+ *  \param count The number of processes besides idle.
+ *  \param strategy The strategy to replay.
+ *  \param ticks The number of decisions.
+ *  \param seed The seed for the workload and the strategies.
+ *  \param records Receives what was recorded about every process.
+ *  \return The results.
+ */
+static RunResult simRun(ProcessModel const models[], uint8_t count, SchedulingStrategy strategy,
+                        uint32_t ticks, uint32_t seed, ProcessRecord records[]) {
+    static uint32_t histogram[WAIT_BUCKETS];
+    memset(histogram, 0, sizeof(histogram));
+    memset(records, 0, sizeof(ProcessRecord) * MAX_NUMBER_OF_PROCESSES);
+    memset(processes, 0, sizeof(processes));
+    simRandomState = seed;
+    srand(seed);
+
+    readySet = 0;
+    for (ProcessID pid = 0; pid <= count; pid++) {
+        processes[pid].state = OS_PS_READY;
+        processes[pid].priority = pid ? models[pid].priority : DEFAULT_PRIORITY;
+        readySet |= PROCESS_BIT(pid);
+        os_resetProcessSchedulingInformation(pid);
+        if (pid) {
+            records[pid].remaining = models[pid].burstMax ? simRandomRange(models[pid].burstMin, models[pid].burstMax) : 0;
+            records[pid].waiting = true;
+        }
+    }
+    currentProc = 0;
+    simTicks = 0;
+    processes[0].state = OS_PS_RUNNING;
+    os_resetSchedulingInformation(strategy);
+    SchedulingStrategyFunction* const function = strategyFunctions[strategy];
+
+    uint64_t cycles = 0;
+    uint64_t maxCycles = 0;
+    uint64_t waits = 0;
+    uint32_t waitMax = 0;
+    for (uint32_t tick = 0; tick < ticks; tick++) {
+        simTicks = tick * SIM_TICK_COUNTS;
+        for (ProcessID pid = 1; pid <= count; pid++) {
+            if (processes[pid].state == OS_PS_BLOCKED && !--records[pid].remaining) {
+                processes[pid].state = OS_PS_READY;
+                readySet |= PROCESS_BIT(pid);
+                records[pid].remaining = simRandomRange(models[pid].burstMin, models[pid].burstMax);
+                records[pid].readySince = tick;
+                records[pid].waiting = true;
+            }
+        }
+
+        uint64_t const start = simCycles();
+        ProcessID const next = function(processes, currentProc);
+        uint64_t const end = simCycles();
+        uint64_t const spent = end - start > cycleOverhead ? end - start - cycleOverhead : 0;
+        cycles += spent;
+        if (spent > maxCycles) {
+            maxCycles = spent;
+        }
+
+        if (processes[currentProc].state == OS_PS_RUNNING) {
+            processes[currentProc].state = OS_PS_READY;
+            if (currentProc != next) {
+                records[currentProc].readySince = tick;
+                records[currentProc].waiting = true;
+            }
+        }
+        if (next && records[next].waiting) {
+            uint32_t const wait = tick - records[next].readySince;
+            histogram[wait < WAIT_BUCKETS ? wait : WAIT_BUCKETS - 1]++;
+            waits++;
+            if (wait > waitMax) {
+                waitMax = wait;
+            }
+        }
+        records[next].waiting = false;
+        processes[next].state = OS_PS_RUNNING;
+        currentProc = next;
+
+        for (ProcessID pid = 1; pid <= count; pid++) {
+            if (readySet & PROCESS_BIT(pid)) {
+                records[pid].ready++;
+            }
+        }
+        records[next].run++;
+        if (next && models[next].burstMax && !--records[next].remaining) {
+            processes[next].state = OS_PS_BLOCKED;
+            readySet &= ~PROCESS_BIT(next);
+            records[next].remaining = simRandomRange(models[next].blockMin, models[next].blockMax);
+        }
+    }
+
+    RunResult result = {
+        .cyclesPerDecision = (double)cycles / ticks,
+        .maxCycles = maxCycles,
+        .waitP50 = simPercentile(histogram, waits, 0.50),
+        .waitP90 = simPercentile(histogram, waits, 0.90),
+        .waitP99 = simPercentile(histogram, waits, 0.99),
+        .waitMax = waitMax
+    };
+    result.nsPerDecision = SIM_HAS_TSC ? result.cyclesPerDecision / cyclesPerNs : result.cyclesPerDecision;
+
+    double sum = 0;
+    double sumSquares = 0;
+    uint8_t members = 0;
+    for (ProcessID pid = 1; pid <= count; pid++) {
+        if (!records[pid].ready) {
+            continue;
+        }
+        if (!records[pid].run) {
+            result.starved++;
+        }
+        double const x = (double)records[pid].run / ((double)records[pid].ready * models[pid].priority);
+        sum += x;
+        sumSquares += x * x;
+        members++;
+    }
+    result.fairness = sumSquares > 0 ? (sum * sum) / (members * sumSquares) : 0;
+    return result;
+}
+
+//----------------------------------------------------------------------------
+// Main
+//----------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    uint32_t ticks = 100000;
+    uint32_t seed = 1;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            ticks = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "usage: %s [-t ticks] [-s seed] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!ticks || !seed) {
+        fprintf(stderr, "ticks and seed must not be 0\n");
+        return 2;
+    }
+
+    simCalibrate();
+    uint8_t const count = MAX_NUMBER_OF_PROCESSES - 1;
+    printf("%u processes + idle, %lu ticks, seed %lu%s\n", count, (unsigned long)ticks, (unsigned long)seed,
+           SIM_HAS_TSC ? "" : ", no cycle counter (cycles are ns)");
+
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        ProcessModel models[MAX_NUMBER_OF_PROCESSES] = {{0}};
+        simRandomState = seed;
+        workloads[w].setup(models, count);
+
+        printf("\nworkload %s\n", workloads[w].name);
+        printf("%-16s %8s %8s %8s %8s %6s %6s %6s %6s %7s\n", "strategy", "ns/dec", "cyc/dec", "max cyc",
+               "fairness", "p50", "p90", "p99", "max", "starved");
+        for (SchedulingStrategy strategy = 0; strategy < OS_SS_COUNT; strategy++) {
+            ProcessRecord records[MAX_NUMBER_OF_PROCESSES];
+            RunResult const r = simRun(models, count, strategy, ticks, seed, records);
+            printf("%-16s %8.1f %8.1f %8llu %8.3f %6lu %6lu %6lu %6lu %7u\n", strategyNames[strategy],
+                   r.nsPerDecision, r.cyclesPerDecision, (unsigned long long)r.maxCycles, r.fairness,
+                   (unsigned long)r.waitP50, (unsigned long)r.waitP90, (unsigned long)r.waitP99,
+                   (unsigned long)r.waitMax, r.starved);
+            if (verbose) {
+                for (ProcessID pid = 1; pid <= count; pid++) {
+                    printf("    #%-2u prio %3u  run %6.2f%%  ready %6.2f%%\n", pid, models[pid].priority,
+                           100.0 * records[pid].run / ticks, 100.0 * records[pid].ready / ticks);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Collects the results of the benchmark in bench.c and compares them.
+
+The output of the benchmark (e.g. of simavr or a serial terminal) is read
+from stdin or a file. Every line of the form
+
+    BENCH <name> min=<cycles> avg=<cycles> max=<cycles> n=<runs>
+
+is printed and, with --output, written to a file that can serve as a
+baseline later. With --baseline, the average of every primitive is compared
+to the baseline and the script fails if one got slower than the tolerance.
+It also fails if the benchmark did not finish.
+
+Usage:
+    simavr -m atmega644 -f 20000000 SPOS.elf | bench_compare.py --output bench.txt
+    bench_compare.py --baseline old.txt --tolerance 5 new.txt
+"""
+
+import argparse
+import re
+import sys
+
+RESULT = re.compile(r"BENCH (\S+) min=(\d+) avg=(\d+) max=(\d+) n=(\d+)")
+DONE = "BENCH done"
+
+
+def parse(lines):
+    """Returns the results as {name: (min, avg, max, n)} and whether the
+    benchmark finished."""
+    results = {}
+    done = False
+    for line in lines:
+        match = RESULT.search(line)
+        if match:
+            results[match.group(1)] = tuple(int(v) for v in match.groups()[1:])
+        elif DONE in line:
+            done = True
+    return results, done
+
+
+def format_result(name, result):
+    return "BENCH %s min=%d avg=%d max=%d n=%d" % ((name,) + result)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("input", nargs="?", help="benchmark output (default: stdin)")
+    parser.add_argument("--output", help="file to write the result lines to")
+    parser.add_argument("--baseline", help="result lines of an earlier run")
+    parser.add_argument("--tolerance", type=float, default=10,
+                        help="allowed slowdown of the average in percent (default: 10)")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input, errors="replace") as stream:
+            results, done = parse(stream)
+    else:
+        results, done = parse(sys.stdin)
+
+    lines = [format_result(name, result) for name, result in results.items()]
+    for line in lines:
+        print(line)
+    if args.output:
+        with open(args.output, "w") as stream:
+            stream.write("".join(line + "\n" for line in lines))
+    if not done:
+        print("benchmark did not finish", file=sys.stderr)
+        return 1
+
+    if not args.baseline:
+        return 0
+    with open(args.baseline) as stream:
+        baseline, _ = parse(stream)
+    failed = False
+    for name, (_, old, _, _) in sorted(baseline.items()):
+        if name not in results:
+            print("%-20s missing" % name)
+            failed = True
+            continue
+        new = results[name][1]
+        change = 100.0 * (new - old) / old if old else 0.0
+        slower = change > args.tolerance
+        failed |= slower
+        print("%-20s %8d -> %8d cycles %+7.1f%%%s" % (name, old, new, change,
+                                                      "  SLOWER" if slower else ""))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Decodes the event trace that SPOS sends over USART0 (see os_trace.h).
+
+The trace is read from a file or, with --port, from a serial port (needs
+pyserial). Every event is printed with its time in microseconds. A summary
+with the CPU share of every process, the longest critical sections and the
+longest delays between a wakeup and the next run of the process is printed
+at the end. With --vcd, a value change dump is written that shows which
+process runs and who is in a critical section, e.g. for GTKWave.
+
+Usage:
+    trace_decode.py trace.bin
+    trace_decode.py --port /dev/ttyUSB0 --vcd trace.vcd
+"""
+
+import argparse
+import sys
+
+F_CPU = 20000000
+TC0_PRESCALER = 256
+US_PER_TICK = TC0_PRESCALER * 1e6 / F_CPU
+TICK_BITS = 21
+BAUD = 250000
+
+EVENTS = ["SWITCH_OUT", "SWITCH_IN", "EXEC", "BLOCK", "WAKE",
+          "ENTER_CS", "LEAVE_CS", "LOST"]
+
+
+def records(stream):
+    """Yields (event, pid, value) tuples. Bytes before the first event and
+    incomplete events are skipped, so decoding may start anywhere."""
+    record = []
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            return
+        for byte in chunk:
+            if byte & 0x80:
+                record = [byte]
+            elif record:
+                record.append(byte)
+                if len(record) == 4:
+                    head = record[0]
+                    value = record[1] | record[2] << 7 | record[3] << 14
+                    yield (head >> 4) & 0x07, head & 0x0F, value
+                    record = []
+
+
+def timed(events):
+    """Adds a continuous time in ticks to SWITCH and other events by undoing
+    the wrap-around of the 21 bit time field."""
+    last = None
+    offset = 0
+    for event, pid, value in events:
+        if EVENTS[event] == "LOST":
+            yield event, pid, value, None
+            continue
+        if last is not None and value < last:
+            offset += 1 << TICK_BITS
+        last = value
+        yield event, pid, value, offset + value
+
+
+class Summary:
+    def __init__(self):
+        self.running = None
+        self.since = None
+        self.runtime = {}
+        self.switches = {}
+        self.csStart = {}
+        self.csDepth = {}
+        self.csLongest = []
+        self.woken = {}
+        self.wakeLatency = []
+        self.lost = 0
+        self.first = None
+        self.last = None
+
+    def add(self, name, pid, ticks):
+        if ticks is None:
+            return
+        if self.first is None:
+            self.first = ticks
+        self.last = ticks
+        if name == "SWITCH_OUT" and self.running == pid and self.since is not None:
+            self.runtime[pid] = self.runtime.get(pid, 0) + ticks - self.since
+            self.running = None
+        elif name == "SWITCH_IN":
+            self.running = pid
+            self.since = ticks
+            self.switches[pid] = self.switches.get(pid, 0) + 1
+            if pid in self.woken:
+                self.wakeLatency.append((ticks - self.woken.pop(pid), pid, ticks))
+        elif name == "WAKE":
+            self.woken[pid] = ticks
+        elif name == "ENTER_CS":
+            depth = self.csDepth.get(pid, 0)
+            if depth == 0:
+                self.csStart[pid] = ticks
+            self.csDepth[pid] = depth + 1
+        elif name == "LEAVE_CS":
+            depth = self.csDepth.get(pid, 0)
+            if depth == 1 and pid in self.csStart:
+                self.csLongest.append((ticks - self.csStart.pop(pid), pid, ticks))
+            self.csDepth[pid] = max(depth - 1, 0)
+
+    def show(self, out, top=5):
+        if self.first is None:
+            out.write("no events\n")
+            return
+        total = max(self.last - self.first, 1)
+        out.write("\n%.0f us traced, %d events lost\n" % (total * US_PER_TICK, self.lost))
+        out.write("pid  switches  cpu share\n")
+        for pid in sorted(set(self.runtime) | set(self.switches)):
+            out.write("%3d  %8d  %8.1f%%\n" % (pid, self.switches.get(pid, 0),
+                                              100.0 * self.runtime.get(pid, 0) / total))
+        for title, entries in (("longest critical sections", self.csLongest),
+                               ("longest wakeup latencies", self.wakeLatency)):
+            out.write("%s:\n" % title)
+            for length, pid, ticks in sorted(entries, reverse=True)[:top]:
+                out.write("  %10.1f us  pid %d  at %.0f us\n"
+                          % (length * US_PER_TICK, pid, ticks * US_PER_TICK))
+
+
+class Vcd:
+    """Writes the running process and the critical section depth."""
+
+    def __init__(self, out):
+        self.out = out
+        out.write("$timescale 1 us $end\n$scope module spos $end\n")
+        out.write("$var wire 4 p running $end\n$var wire 8 c critical $end\n")
+        out.write("$upscope $end\n$enddefinitions $end\n")
+        self.depth = 0
+
+    def add(self, name, pid, ticks):
+        if ticks is None:
+            return
+        stamp = "#%d\n" % round(ticks * US_PER_TICK)
+        if name == "SWITCH_IN":
+            self.out.write(stamp + "b{:b} p\n".format(pid))
+        elif name == "SWITCH_OUT":
+            self.out.write(stamp + "bz p\n")
+        elif name in ("ENTER_CS", "LEAVE_CS"):
+            self.depth = max(self.depth + (1 if name == "ENTER_CS" else -1), 0)
+            self.out.write(stamp + "b{:b} c\n".format(self.depth))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file", nargs="?", help="captured trace (default: stdin)")
+    parser.add_argument("--port", help="read from this serial port instead")
+    parser.add_argument("--vcd", help="write a value change dump to this file")
+    parser.add_argument("--quiet", action="store_true", help="only print the summary")
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, BAUD)
+    elif args.file:
+        stream = open(args.file, "rb")
+    else:
+        stream = sys.stdin.buffer
+
+    summary = Summary()
+    vcd = Vcd(open(args.vcd, "w")) if args.vcd else None
+    try:
+        for event, pid, value, ticks in timed(records(stream)):
+            name = EVENTS[event]
+            if name == "LOST":
+                summary.lost += value
+                if not args.quiet:
+                    print("%12s  %d events lost" % ("", value))
+                continue
+            if not args.quiet:
+                print("%12.1f  %-10s  pid %d" % (ticks * US_PER_TICK, name, pid))
+            summary.add(name, pid, ticks)
+            if vcd:
+                vcd.add(name, pid, ticks)
+    except KeyboardInterrupt:
+        pass
+    summary.show(sys.stdout)
+
+
+if __name__ == "__main__":
+    main()